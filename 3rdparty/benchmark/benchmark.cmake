@@ -0,0 +1,14 @@
+Include(FetchContent)
+
+set(BENCHMARK_ENABLE_TESTING OFF)
+set(BENCHMARK_ENABLE_GTEST_TESTS OFF)
+set(BENCHMARK_ENABLE_INSTALL OFF)
+
+FetchContent_Declare(
+  benchmark
+  GIT_REPOSITORY https://github.com/google/benchmark.git
+  GIT_TAG        v1.8.3
+  GIT_PROGRESS   TRUE
+)
+
+FetchContent_MakeAvailable(benchmark)
\ No newline at end of file
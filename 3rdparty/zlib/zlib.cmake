@@ -1,5 +1,9 @@
 include(FetchContent)
 
+set(ZLIB_ENABLE_TESTS OFF)
+set(ZLIBNG_ENABLE_TESTS OFF)
+set(WITH_GTEST OFF)
+
 FetchContent_Declare(
 	zlib
 	GIT_REPOSITORY	https://github.com/zlib-ng/zlib-ng.git
@@ -0,0 +1,319 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures compress and decompress speed and compression ratio of the codecs, their
+ * levels, block sizes, chains and thread counts on map-like data. Prints JSON unless
+ * another `--benchmark_format` is given. `bytes_per_second` is the uncompressed size
+ * over the time, and `ratio` the uncompressed over the compressed size.
+ */
+
+// UFO
+#include <ufo/compression/compression.hpp>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Benchmark
+#include <benchmark/benchmark.h>
+
+using namespace ufo;
+
+using size_type = Compressor::size_type;
+
+// Occupancy log-odds of a 256 x 128 x 128 grid, 16 MiB of floats
+constexpr std::size_t DIM_X = 256;
+constexpr std::size_t DIM_Y = 128;
+constexpr std::size_t DIM_Z = 128;
+
+/*
+ * A map the way a robot sees it: free space up to the range of the sensor, seen less
+ * often further away, and unknown beyond, a noisy occupied ground and noisy occupied
+ * surfaces of a few boxes.
+ */
+std::vector<std::byte> const& mapData()
+{
+	static std::vector<std::byte> const data = []() {
+		constexpr float UNKNOWN  = 0.0f;
+		constexpr float FREE     = -0.4f;
+		constexpr float OCCUPIED = 3.5f;
+
+		std::mt19937                    gen(42);
+		std::normal_distribution<float> noise(0.0f, 0.4f);
+		std::uniform_int_distribution   pos(0, 96);
+		std::uniform_int_distribution   extent(4, 32);
+		std::bernoulli_distribution     miss(0.3);
+
+		struct Box {
+			std::size_t min[3];
+			std::size_t max[3];
+		};
+		std::vector<Box> boxes(24);
+		for (auto& b : boxes) {
+			for (int i{}; 3 > i; ++i) {
+				b.min[i] = static_cast<std::size_t>(pos(gen));
+				b.max[i] = b.min[i] + static_cast<std::size_t>(extent(gen));
+			}
+		}
+
+		auto surface = [&boxes](std::size_t x, std::size_t y, std::size_t z) {
+			return std::any_of(boxes.begin(), boxes.end(), [=](Box const& b) {
+				bool inside = b.min[0] <= x && b.max[0] >= x && b.min[1] <= y &&
+				              b.max[1] >= y && b.min[2] <= z && b.max[2] >= z;
+				return inside && (b.min[0] == x || b.max[0] == x || b.min[1] == y ||
+				                  b.max[1] == y || b.min[2] == z || b.max[2] == z);
+			});
+		};
+
+		std::vector<float> grid(DIM_X * DIM_Y * DIM_Z);
+		for (std::size_t x{}; DIM_X > x; ++x) {
+			for (std::size_t y{}; DIM_Y > y; ++y) {
+				for (std::size_t z{}; DIM_Z > z; ++z) {
+					float v;
+					if (2 > z || surface(x, y, z)) {
+						// Quantized like a map stores it
+						v = std::round((OCCUPIED + noise(gen)) * 100.0f) / 100.0f;
+					} else if (200 > x + z) {
+						v = FREE * static_cast<float>(5 - (x + z) / 50 - miss(gen));
+					} else {
+						v = UNKNOWN;
+					}
+					grid[(x * DIM_Y + y) * DIM_Z + z] = v;
+				}
+			}
+		}
+
+		std::vector<std::byte> bytes(grid.size() * sizeof(float));
+		std::memcpy(bytes.data(), grid.data(), bytes.size());
+		return bytes;
+	}();
+	return data;
+}
+
+void compressBench(benchmark::State& state, Compressor const& compressor, bool native)
+{
+	auto const& data = mapData();
+
+	WriteBuffer out;
+	for (auto _ : state) {
+		out.clear();
+		ReadBuffer in(data.data(), data.size());
+		compressor.compress(in, out, native);
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+
+	state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * data.size()));
+	state.counters["ratio"] = static_cast<double>(data.size()) / out.size();
+}
+
+void decompressBench(benchmark::State& state, Compressor const& compressor, bool native)
+{
+	auto const& data = mapData();
+
+	WriteBuffer compressed;
+	ReadBuffer  uncompressed(data.data(), data.size());
+	compressor.compress(uncompressed, compressed, native);
+
+	WriteBuffer out;
+	for (auto _ : state) {
+		out.clear();
+		ReadBuffer in(compressed.data(), compressed.size());
+		compressor.decompress(in, out, native);
+		benchmark::DoNotOptimize(out.data());
+		benchmark::ClobberMemory();
+	}
+
+	if (data.size() != out.size() ||
+	    0 != std::memcmp(data.data(), out.data(), data.size())) {
+		state.SkipWithError("round trip mismatch");
+	}
+
+	state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * data.size()));
+	state.counters["ratio"] = static_cast<double>(data.size()) / compressed.size();
+}
+
+struct Case {
+	// Names the compressor (chain) and its level, e.g. "shuffle+zstd:3"
+	std::string                                  name;
+	std::function<std::unique_ptr<Compressor>()> make;
+	// Appends the compressor to a chain
+	std::function<void(Compressor&)> append;
+};
+
+template <class Comp, class... Args>
+Case make(std::string name, Args... args)
+{
+	return {std::move(name), [args...]() { return std::make_unique<Comp>(args...); },
+	        [args...](Compressor& c) { c.next(Comp(args...)); }};
+}
+
+// `first` followed by `second`
+Case chain(Case const& first, Case const& second)
+{
+	auto create = [first, second]() {
+		auto c = first.make();
+		second.append(*c);
+		return c;
+	};
+	return {first.name + "+" + second.name, create, {}};
+}
+
+std::string sizeName(size_type size)
+{
+	return 0 == size % (1024 * 1024) ? std::to_string(size / (1024 * 1024)) + "M"
+	                                 : std::to_string(size / 1024) + "K";
+}
+
+/*
+ * Registers compress and decompress of `c` with the given block size and number of
+ * threads, named `<op>/<compressor>/bs:<block size>/t:<threads>/<format>`, where the
+ * format is either the non-native frame or the native format.
+ */
+void add(Case const& c, size_type block_size, std::size_t num_threads, bool native)
+{
+	std::shared_ptr<Compressor> compressor(c.make());
+	compressor->block_size  = block_size;
+	compressor->num_threads = num_threads;
+
+	auto name = c.name + "/bs:" + sizeName(block_size) + "/t:" +
+	            std::to_string(num_threads) + (native ? "/native" : "/frame");
+
+	auto op = [&](std::string_view prefix, auto f) {
+		auto run = [compressor, native, f](benchmark::State& state) {
+			f(state, *compressor, native);
+		};
+		benchmark::RegisterBenchmark((std::string(prefix) + "/" + name).c_str(), run)
+		    ->Unit(benchmark::kMillisecond)
+		    ->UseRealTime();
+	};
+	op("compress", compressBench);
+	op("decompress", decompressBench);
+}
+
+void registerBenchmarks()
+{
+	constexpr size_type DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
+	// Every codec at a range of levels, on one thread
+	std::vector<Case> codecs{make<CompressorNONE>("none")};
+	for (int acceleration : {1, 8, 32}) {
+		codecs.push_back(make<CompressorLZ4>("lz4:" + std::to_string(acceleration),
+		                                     acceleration));
+	}
+	for (int level : {4, 9}) {
+		codecs.push_back(make<CompressorLZ4>("lz4hc:" + std::to_string(level), 1, level));
+	}
+	for (int hash_log : {10, 14, 18}) {
+		codecs.push_back(make<CompressorLZF>("lzf:" + std::to_string(hash_log), hash_log));
+	}
+	for (int level : {1, 6, 9}) {
+		codecs.push_back(make<CompressorZLIB>("zlib:" + std::to_string(level), level));
+	}
+	for (int level : {-5, 1, 3, 9, 15}) {
+		codecs.push_back(make<CompressorZSTD>("zstd:" + std::to_string(level), level));
+	}
+	for (auto const& c : codecs) {
+		add(c, DEFAULT_BLOCK_SIZE, 1, false);
+		add(c, DEFAULT_BLOCK_SIZE, 1, true);
+	}
+
+	auto lz4  = make<CompressorLZ4>("lz4:1", 1);
+	auto zstd = make<CompressorZSTD>("zstd:3", 3);
+
+	// Block sizes of the frame
+	for (size_type block_size : {64 * 1024, 256 * 1024, 1024 * 1024, 16 * 1024 * 1024}) {
+		add(lz4, block_size, 1, false);
+		add(zstd, block_size, 1, false);
+	}
+
+	// Filters in front of the codecs
+	std::size_t const float_size = sizeof(float);
+	for (auto const& filter : {make<CompressorSHUFFLE>("shuffle", float_size),
+	                           make<CompressorBITSHUFFLE>("bitshuffle", float_size),
+	                           make<CompressorDELTA>("delta", float_size),
+	                           make<CompressorXOR>("xor", float_size),
+	                           make<CompressorRLE>("rle", float_size)}) {
+		for (auto const& codec : {lz4, zstd, make<CompressorLZF>("lzf:16", 16)}) {
+			add(chain(filter, codec), DEFAULT_BLOCK_SIZE, 1, false);
+		}
+	}
+
+	// Threads, where 0 is all threads of the shared pool
+	for (std::size_t num_threads : {2, 4, 8, 0}) {
+		add(lz4, 1024 * 1024, num_threads, false);
+		add(zstd, 1024 * 1024, num_threads, false);
+		add(chain(make<CompressorSHUFFLE>("shuffle", float_size), zstd), 1024 * 1024,
+		    num_threads, false);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	registerBenchmarks();
+
+	std::string        json = "--benchmark_format=json";
+	std::vector<char*> args(argv, argv + argc);
+	if (std::none_of(args.begin() + 1, args.end(), [](char const* arg) {
+		    return 0 == std::string_view(arg).rfind("--benchmark_format", 0);
+	    })) {
+		args.insert(args.begin() + 1, json.data());
+	}
+
+	auto n = static_cast<int>(args.size());
+	benchmark::Initialize(&n, args.data());
+	if (benchmark::ReportUnrecognizedArguments(n, args.data())) {
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
\ No newline at end of file
@@ -49,11 +49,17 @@
 namespace ufo
 {
 enum class CompressionAlgorithm : std::uint32_t {
-	NONE = 0,
-	LZ4  = 1,
-	ZSTD = 2,
-	LZF  = 3,
-	ZLIB = 4
+	NONE       = 0,
+	LZ4        = 1,
+	ZSTD       = 2,
+	LZF        = 3,
+	ZLIB       = 4,
+	SHUFFLE    = 5,
+	BITSHUFFLE = 6,
+	DELTA      = 7,
+	XOR        = 8,
+	QUANTIZE   = 9,
+	RLE        = 10
 };
 
 template <CompressionAlgorithm CAlg>
@@ -70,6 +76,18 @@ template <CompressionAlgorithm CAlg>
 		return "lzf"sv;
 	} else if constexpr (CompressionAlgorithm::ZLIB == CAlg) {
 		return "zlib"sv;
+	} else if constexpr (CompressionAlgorithm::SHUFFLE == CAlg) {
+		return "shuffle"sv;
+	} else if constexpr (CompressionAlgorithm::BITSHUFFLE == CAlg) {
+		return "bitshuffle"sv;
+	} else if constexpr (CompressionAlgorithm::DELTA == CAlg) {
+		return "delta"sv;
+	} else if constexpr (CompressionAlgorithm::XOR == CAlg) {
+		return "xor"sv;
+	} else if constexpr (CompressionAlgorithm::QUANTIZE == CAlg) {
+		return "quantize"sv;
+	} else if constexpr (CompressionAlgorithm::RLE == CAlg) {
+		return "rle"sv;
 	} else {
 		// Error
 	}
@@ -83,6 +101,15 @@ template <CompressionAlgorithm CAlg>
 		case CompressionAlgorithm::ZSTD: return enumToString<CompressionAlgorithm::ZSTD>();
 		case CompressionAlgorithm::LZF: return enumToString<CompressionAlgorithm::LZF>();
 		case CompressionAlgorithm::ZLIB: return enumToString<CompressionAlgorithm::ZLIB>();
+		case CompressionAlgorithm::SHUFFLE:
+			return enumToString<CompressionAlgorithm::SHUFFLE>();
+		case CompressionAlgorithm::BITSHUFFLE:
+			return enumToString<CompressionAlgorithm::BITSHUFFLE>();
+		case CompressionAlgorithm::DELTA: return enumToString<CompressionAlgorithm::DELTA>();
+		case CompressionAlgorithm::XOR: return enumToString<CompressionAlgorithm::XOR>();
+		case CompressionAlgorithm::QUANTIZE:
+			return enumToString<CompressionAlgorithm::QUANTIZE>();
+		case CompressionAlgorithm::RLE: return enumToString<CompressionAlgorithm::RLE>();
 	}
 	// Error
 	return "";
@@ -0,0 +1,114 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_COMPRESSION_CANCELLATION_HPP
+#define UFO_COMPRESSION_CANCELLATION_HPP
+
+// STL
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+
+namespace ufo
+{
+/*!
+ * @brief Lets another thread stop a running compress or decompress call.
+ *
+ * Copies share their state, so cancelling one cancels all of them. A default
+ * constructed token is never cancelled, use `create()` for one that can be.
+ */
+class CancellationToken
+{
+ public:
+	CancellationToken() noexcept = default;
+
+	[[nodiscard]] static CancellationToken create()
+	{
+		CancellationToken token;
+		token.cancelled_ = std::make_shared<std::atomic<bool>>(false);
+		return token;
+	}
+
+	/*!
+	 * @brief Cancels all calls using this token, does nothing for a default constructed
+	 * token.
+	 */
+	void cancel() const noexcept
+	{
+		if (cancelled_) {
+			cancelled_->store(true, std::memory_order_relaxed);
+		}
+	}
+
+	[[nodiscard]] bool cancelled() const noexcept
+	{
+		return cancelled_ && cancelled_->load(std::memory_order_relaxed);
+	}
+
+ private:
+	std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+/*!
+ * @brief Thrown by a compress or decompress call that was cancelled or passed its
+ * deadline. The output is left incomplete.
+ */
+class CompressionCancelled : public std::runtime_error
+{
+ public:
+	enum class Reason { CANCELLED, DEADLINE };
+
+	explicit CompressionCancelled(Reason reason)
+	    : std::runtime_error(Reason::CANCELLED == reason
+	                             ? "ufo::Compressor: cancelled"
+	                             : "ufo::Compressor: deadline exceeded")
+	    , reason_(reason)
+	{
+	}
+
+	[[nodiscard]] Reason reason() const noexcept { return reason_; }
+
+ private:
+	Reason reason_;
+};
+}  // namespace ufo
+
+#endif  // UFO_COMPRESSION_CANCELLATION_HPP
\ No newline at end of file
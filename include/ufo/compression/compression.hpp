@@ -44,10 +44,15 @@
 
 // UFO
 #include <ufo/compression/algorithm.hpp>
+#include <ufo/compression/cancellation.hpp>
 #include <ufo/compression/compressor.hpp>
+#include <ufo/compression/delta.hpp>
 #include <ufo/compression/lz4.hpp>
 #include <ufo/compression/lzf.hpp>
 #include <ufo/compression/none.hpp>
+#include <ufo/compression/quantize.hpp>
+#include <ufo/compression/rle.hpp>
+#include <ufo/compression/shuffle.hpp>
 #include <ufo/compression/zlib.hpp>
 #include <ufo/compression/zstd.hpp>
 
@@ -44,17 +44,24 @@
 
 // UFO
 #include <ufo/compression/algorithm.hpp>
+#include <ufo/compression/cancellation.hpp>
+#include <ufo/compression/thread_pool.hpp>
 #include <ufo/utility/io/buffer.hpp>
 
 // STL
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <exception>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace ufo
@@ -73,9 +80,53 @@ inline constexpr bool is_compressor_v = is_compressor<T>::value;
 struct Compressor {
 	using size_type = std::uintmax_t;
 
+	// Completion of `compressAsync` and `decompressAsync`, with the result or the error
+	using Callback = std::function<void(std::vector<std::byte>, std::exception_ptr)>;
+
+	// Number of uncompressed bytes per block when not using the native format (at most
+	// 1 GiB), and the size of each buffer between the stages of the chain when using it
+	size_type block_size = 4 * 1024 * 1024;
+
+	// Number of threads of the shared pool (see `ThreadPool::shared`) blocks are
+	// compressed on when not using the native format, where 0 means all of them
+	std::size_t num_threads = 1;
+
+	// Whether blocks of the non-native format are passed from one compressor of the chain
+	// to the next, each compressor working on a different block at the same time as a
+	// task on the shared pool, instead of one task running the whole chain on a block.
+	// Used instead of `num_threads` for chains of more than one compressor.
+	bool pipeline = false;
+
+	// Adaptive mode, used by the non-native format when either is set: the level of the
+	// compressors in the chain is adjusted block by block, from the measured speed, such
+	// that compressing runs at about `target_speed` bytes per second or such that a call
+	// takes about `time_budget`. Blocks decompress the same at any level.
+	double                        target_speed = 0;
+	std::chrono::duration<double> time_budget{};
+
+	// Priority of the tasks run on the shared pool, both the blocks and the asynchronous
+	// calls. Queued blocks of a more urgent call are taken before those of less urgent
+	// ones, so a small urgent call only waits for blocks that are already running.
+	Priority priority = Priority::NORMAL;
+
+	// Stop a call at the next block boundary (the next buffer for the native format),
+	// throwing `CompressionCancelled`, once `cancellation` is cancelled or `deadline` has
+	// passed. Archives stop at the next block of any of their files.
+	CancellationToken                     cancellation;
+	std::chrono::steady_clock::time_point deadline =
+	    std::chrono::steady_clock::time_point::max();
+
 	Compressor() noexcept = default;
 
 	Compressor(Compressor const& other)
+	    : block_size(other.block_size)
+	    , num_threads(other.num_threads)
+	    , pipeline(other.pipeline)
+	    , target_speed(other.target_speed)
+	    , time_budget(other.time_budget)
+	    , priority(other.priority)
+	    , cancellation(other.cancellation)
+	    , deadline(other.deadline)
 	{
 		if (other.next_) {
 			next_.reset(other.next_->clone());
@@ -88,8 +139,16 @@ struct Compressor {
 
 	Compressor& operator=(Compressor const& rhs)
 	{
-		if (rhs.next_) {
-			next_.reset(rhs.clone());
+		if (this != &rhs) {
+			block_size   = rhs.block_size;
+			num_threads  = rhs.num_threads;
+			pipeline     = rhs.pipeline;
+			target_speed = rhs.target_speed;
+			time_budget  = rhs.time_budget;
+			priority     = rhs.priority;
+			cancellation = rhs.cancellation;
+			deadline     = rhs.deadline;
+			next_.reset(rhs.next_ ? rhs.next_->clone() : nullptr);
 		}
 		return *this;
 	}
@@ -99,7 +158,7 @@ struct Compressor {
 	[[nodiscard]] size_type size() const
 	{
 		size_type ret = 1;
-		for (auto it = &next(); it; it = &it->next()) {
+		for (auto it = next_.get(); it; it = it->next_.get()) {
 			++ret;
 		}
 		return ret;
@@ -129,8 +188,7 @@ struct Compressor {
 	{
 		std::vector<CompressionAlgorithm> chain;
 		chain.reserve(size());
-		chain.push_back(type());
-		for (auto it = &next(); it; it = &it->next()) {
+		for (auto it = this; it; it = it->next_.get()) {
 			chain.push_back(it->type());
 		}
 		return chain;
@@ -140,8 +198,7 @@ struct Compressor {
 	{
 		std::vector<Compressor*> chain;
 		chain.reserve(size());
-		chain.push_back(this);
-		for (auto it = &next(); it; it = &it->next()) {
+		for (auto it = this; it; it = it->next_.get()) {
 			chain.push_back(it);
 		}
 		return chain;
@@ -151,13 +208,24 @@ struct Compressor {
 	{
 		std::vector<Compressor const*> chain;
 		chain.reserve(size());
-		chain.push_back(this);
-		for (auto it = &next(); it; it = &it->next()) {
+		for (auto it = this; it; it = it->next_.get()) {
 			chain.push_back(it);
 		}
 		return chain;
 	}
 
+	/*!
+	 * @brief Creates a compressor with default settings for the algorithm.
+	 */
+	[[nodiscard]] static std::unique_ptr<Compressor> create(CompressionAlgorithm algorithm);
+
+	/*!
+	 * @brief Creates a chain of compressors with default settings, such that
+	 * `create(chain)->typeChain() == chain`.
+	 */
+	[[nodiscard]] static std::unique_ptr<Compressor> create(
+	    std::vector<CompressionAlgorithm> const& chain);
+
 	[[nodiscard]] size_type maxSize(bool native = false) const
 	{
 		if (!native) {
@@ -167,155 +235,191 @@ struct Compressor {
 		// FIXME: Can be incorrect since compressed can be larger than uncompressed
 
 		auto ms = maxSizeImpl();
-		for (auto it = &next(); it; it = &it->next()) {
+		for (auto it = next_.get(); it; it = it->next_.get()) {
 			ms = std::min(ms, it->maxSizeImpl());
 		}
 		return ms;
 	}
 
+	/*!
+	 * @brief Upper bound of the compressed size of `uncompressed_size` bytes.
+	 *
+	 * With `native` this is the bound of passing the data through the chain in one go,
+	 * which does not include the framing of the streaming formats.
+	 */
 	[[nodiscard]] size_type compressBound(size_type uncompressed_size,
-	                                      bool      native = false) const
-	{
-		if (native) {
-			auto bound = compressBoundImpl(uncompressed_size);
-			for (auto it = &next(); it; it = &it->next()) {
-				bound = it->compressBoundImpl(bound);
-			}
-			return bound;
-		} else {
-			size_type bound = uncompressed_size;
-			for (auto it = this; it; it = &it->next()) {
-				auto ms = it->maxSizeImpl();
-				auto a  = bound / ms;
-				auto b  = bound % ms;
-
-				bound = a * it->compressBoundImpl(ms) + it->compressBoundImpl(b) +
-				        (a + 2) * sizeof(std::uint64_t);
-			}
-
-			// Add cost of chain
-			return (size() + 1) * sizeof(CompressionAlgorithm) + bound;
-		}
-	}
-
+	                                      bool      native = false) const;
+
+	/*!
+	 * @brief Archives the directory (or regular file) `in` to the file `out`.
+	 *
+	 * Each file is compressed into a non-native frame of its own, files being compressed
+	 * in parallel using up to `num_threads` threads, followed by an index of all files and
+	 * directories. Empty directories are kept, while anything that is neither a file nor
+	 * a directory is skipped.
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
 	size_type compress(std::filesystem::path const& in,
-	                   std::filesystem::path const& out) const
-	{
-		size_type   uncompressed_size{};
-		std::size_t num{};
-		if (std::filesystem::is_directory(in)) {
-			for (auto const& entry : std::filesystem::recursive_directory_iterator(in)) {
-				if (entry.is_regular_file()) {
-					++num;
-					uncompressed_size += std::filesystem::file_size(entry.path());
-				} else if (entry.is_directory()) {
-					++num;
-				}
-			}
-		}
-
-		std::cout << "Num: " << num << '\n';
-		std::cout << "Size: " << uncompressed_size << '\n';
-
-		return 0;
-	}
-
+	                   std::filesystem::path const& out) const;
+
+	/*!
+	 * @brief Extracts an archive written by `compress` to the directory `out`, which is
+	 * created if needed. Files are decompressed in parallel using up to `num_threads`
+	 * threads, with this compressor's settings where their chain matches.
+	 *
+	 * @return The number of bytes extracted.
+	 */
+	size_type decompress(std::filesystem::path const& in,
+	                     std::filesystem::path const& out) const;
+
+	/*!
+	 * @brief Compresses `uncompressed_size` bytes from `in` and writes them to `out`.
+	 *
+	 * In the non-native format the input is split into blocks of `block_size` bytes
+	 * that are passed through the whole chain independently, using up to `num_threads`
+	 * threads, and written in order. The result is preceded by
+	 * a header describing the chain, such that it can be read back by `decompress`
+	 * without knowing how it was compressed.
+	 *
+	 * In the native format the input is streamed through the chain without any header,
+	 * using each compressor's own streaming format (e.g., an LZ4 frame or a zstd frame),
+	 * with a working set of a few `block_size` buffers regardless of the input size.
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
 	size_type compress(std::istream& in, std::ostream& out, size_type uncompressed_size,
-	                   bool native = false) const
-	{
-		auto compressed_bound = compressBound(uncompressed_size, native);
-
-		auto buffer_size = std::max(uncompressed_size, compressed_bound);
-
-		if (native) {
-			auto src = std::make_unique<std::byte[]>(buffer_size);
-			auto dst = std::make_unique<std::byte[]>(buffer_size);
-
-			in.read(reinterpret_cast<char*>(dst.get()), uncompressed_size);
-
-			auto compressed_size = uncompressed_size;
-			for (auto it = this; it; it = &it->next()) {
-				std::swap(src, dst);
-				compressed_size = compress(src.get(), dst.get(), compressed_size, buffer_size);
-			}
-
-			out.write(reinterpret_cast<char const*>(dst.get()), compressed_size);
-
-			return compressed_size;
-		}
-
-		return 0;
-
-		// std::uint64_t size = static_cast<std::uint64_t>(uncompressed_size);
-
-		// buffer_size += sizeof(size);
-
-		// auto src = std::make_unique<std::byte[]>(buffer_size);
-		// auto dst = std::make_unique<std::byte[]>(buffer_size);
-
-		// // std::memcpy(src.get(), &size, sizeof(size));
-
-		// // in.read(reinterpret_cast<char*>(src.get() + sizeof(size)), uncompressed_size);
-
-		// // compressed_size =
-		// //     compressImpl(src.get(), dst.get(), uncompressed_size, compressed_size);
-
-		// // // TODO: Implement
-		// // for (auto const* it = &next(); it; it = &(it->next())) {
-		// // 	std::swap(src, dst);
-		// // 	compressed_size =
-		// // 	    it->compressImpl(src.get(), dst.get(), compressed_size, buffer_size);
-		// // }
-
-		// // TODO: Implement
-		// out.write(reinterpret_cast<char const*>(dst.get()), compressed_size);
-
-		// return compressed_size;
-	}
-
-	size_type compress(ReadBuffer& in, WriteBuffer& out, bool native = false) const
+	                   bool native = false) const;
+
+	/*!
+	 * @brief Compresses everything left to read in `in` and writes it at the write
+	 * position of `out`, which grows as needed.
+	 *
+	 * Works directly on the memory of the buffers, without intermediate copies.
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
+	size_type compress(ReadBuffer& in, WriteBuffer& out, bool native = false) const;
+
+	/*!
+	 * @brief Compresses the file `in` to the file `out`, like `compress(std::istream&,
+	 * std::ostream&, size_type, bool)` does.
+	 *
+	 * Where supported (POSIX), `in` is mapped into memory and so is `out` in the
+	 * non-native format, such that the data goes from and to the page cache without
+	 * intermediate copies.
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
+	size_type compressFile(std::filesystem::path const& in,
+	                       std::filesystem::path const& out, bool native = false) const;
+
+	/*!
+	 * @brief Decompresses the file `in`, written by `compressFile` or `compress` with the
+	 * same `native` setting, to the file `out`. Memory mapped like `compressFile`.
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
+	size_type decompressFile(std::filesystem::path const& in,
+	                         std::filesystem::path const& out, bool native = false) const;
+
+	/*!
+	 * @brief Decompresses data written by `compress` in the non-native format.
+	 *
+	 * The chain is read from the data, so it does not have to match this compressor.
+	 * The non-static overloads decompress blocks using up to `num_threads` threads, and
+	 * if the chain does match they decompress with this compressor's settings, which
+	 * is needed for settings that are not stored in the data (e.g., a dictionary).
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
+	static size_type decompress(std::istream& in, std::ostream& out);
+
+	static size_type decompress(ReadBuffer& in, WriteBuffer& out);
+
+	/*!
+	 * @brief Decompresses data written by `compress` with the same `native` setting.
+	 *
+	 * The native format does not describe the chain, so it has to match this compressor.
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
+	size_type decompress(std::istream& in, std::ostream& out, bool native) const;
+
+	size_type decompress(ReadBuffer& in, WriteBuffer& out, bool native) const;
+
+	/*!
+	 * @brief Decompresses only the bytes `[offset, offset + length)` of the data written
+	 * by `compress` in the non-native format, and writes them to `out`.
+	 *
+	 * Only the blocks covering the range are read and decompressed, found through the
+	 * block index at the end of the data. If the data does not end there the block
+	 * headers are walked instead. The range is cut off at the end of the data. `in` has
+	 * to be seekable, the overload reading a file maps it into memory where supported,
+	 * and the buffer is left as is. Uses up to `num_threads` threads.
+	 *
+	 * @return The number of bytes written to `out`.
+	 */
+	size_type decompressRange(std::istream& in, std::ostream& out, size_type offset,
+	                          size_type length) const;
+
+	size_type decompressRange(ReadBuffer& in, WriteBuffer& out, size_type offset,
+	                          size_type length) const;
+
+	size_type decompressRange(std::filesystem::path const& in, WriteBuffer& out,
+	                          size_type offset, size_type length) const;
+
+	/*!
+	 * @brief Compresses `in` like `compress(ReadBuffer&, WriteBuffer&, bool)`, but on a
+	 * thread of an executor shared by all compressors, so the calling thread does not
+	 * block. Takes ownership of `in` and works on a copy of this compressor, which can
+	 * therefore be changed or destroyed while the call runs.
+	 *
+	 * @return The compressed data, once done.
+	 */
+	[[nodiscard]] std::future<std::vector<std::byte>> compressAsync(
+	    std::vector<std::byte> in, bool native = false) const;
+
+	/*!
+	 * @brief Like `compressAsync`, but calls `done` on the executor thread with the
+	 * compressed data, or with the exception if compressing failed.
+	 */
+	void compressAsync(std::vector<std::byte> in, Callback done, bool native = false) const;
+
+	/*!
+	 * @brief Decompresses `in` like `decompress(ReadBuffer&, WriteBuffer&, bool)`, on the
+	 * executor of `compressAsync`.
+	 *
+	 * @return The decompressed data, once done.
+	 */
+	[[nodiscard]] std::future<std::vector<std::byte>> decompressAsync(
+	    std::vector<std::byte> in, bool native = false) const;
+
+	/*!
+	 * @brief Like `decompressAsync`, but calls `done` on the executor thread with the
+	 * decompressed data, or with the exception if decompressing failed.
+	 */
+	void decompressAsync(std::vector<std::byte> in, Callback done,
+	                     bool native = false) const;
+
+	/*!
+	 * @brief Incremental (de)compression state, used by the native format.
+	 */
+	class Stream
 	{
-		// TODO: Implement
-		return 0;
-	}
-
-	static size_type decompress(std::istream& in, std::ostream& out)
-	{
-		// TODO: Implement
-		return 0;
-	}
-
-	static size_type decompress(ReadBuffer& in, WriteBuffer& out)
-	{
-		// TODO: Implement
-		return 0;
-	}
-
-	size_type decompress(std::istream& in, std::ostream& out, bool native) const
-	{
-		if (!native) {
-			return decompress(in, out);
-		}
-
-		in.seekg(0, std::ios::seekdir::_S_end);
-
-		std::size_t uncompressed_size = in.tellg();
-
-		in.seekg(0, std::ios::seekdir::_S_beg);
-
-		// TODO: Implement
-		return 0;
-	}
-
-	size_type decompress(ReadBuffer& in, WriteBuffer& out, bool native) const
-	{
-		if (!native) {
-			return decompress(in, out);
-		}
-
-		// TODO: Implement
-		return 0;
-	}
+	 public:
+		virtual ~Stream() = default;
+
+		/*!
+		 * @brief Consumes input from `[src, src_end)` and writes output to `[dst, dst_end)`,
+		 * advancing `src` and `dst` past what has been consumed and written. `finish`
+		 * tells that no more input will follow `src_end`.
+		 *
+		 * @return Whether the stream has ended and all output has been written.
+		 */
+		virtual bool process(std::byte const*& src, std::byte const* src_end,
+		                     std::byte*& dst, std::byte* dst_end, bool finish) = 0;
+	};
 
  protected:
 	[[nodiscard]] virtual size_type maxSizeImpl() const = 0;
@@ -323,14 +427,188 @@ struct Compressor {
 	[[nodiscard]] virtual size_type compressBoundImpl(
 	    size_type uncompressed_size) const = 0;
 
+	/*!
+	 * @return The compressed size, or 0 on failure.
+	 */
 	virtual size_type compress(std::byte const* src, std::byte* dst, size_type src_size,
 	                           size_type dst_cap) const = 0;
 
+	/*!
+	 * @return The decompressed size, or 0 on failure.
+	 */
 	virtual size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
 	                             size_type dst_cap) const = 0;
 
 	[[nodiscard]] virtual Compressor* clone() const = 0;
 
+	/*!
+	 * @brief Number of levels the adaptive mode can choose from, ordered from fastest to
+	 * strongest. Compressors without a level have one.
+	 */
+	[[nodiscard]] virtual int numLevels() const { return 1; }
+
+	/*!
+	 * @brief The level in `[0, numLevels())` closest to the current settings.
+	 */
+	[[nodiscard]] virtual int level() const { return 0; }
+
+	/*!
+	 * @brief Changes the settings to level `level` in `[0, numLevels())`.
+	 */
+	virtual void setLevel(int /* level */) {}
+
+	/*!
+	 * @brief The settings needed to decompress, stored in the header of the non-native
+	 * format. Empty by default.
+	 */
+	[[nodiscard]] virtual std::vector<std::byte> parameters() const { return {}; }
+
+	/*!
+	 * @brief Checks or applies `parameters()` of the compressor that compressed the data
+	 * before decompressing it. Throws if the data cannot be decompressed with these
+	 * settings. The default only accepts empty parameters.
+	 */
+	virtual void setParameters(std::byte const* data, size_type size);
+
+	/*!
+	 * @brief Creates a stream that compresses with this compressor's settings.
+	 *
+	 * The default splits the data into chunks that are compressed separately with
+	 * `compress`, each preceded by its compressed and uncompressed size, and ends with an
+	 * empty chunk.
+	 */
+	[[nodiscard]] virtual std::unique_ptr<Stream> compressStream() const;
+
+	/*!
+	 * @brief Creates a stream that reverses `compressStream`.
+	 */
+	[[nodiscard]] virtual std::unique_ptr<Stream> decompressStream() const;
+
+ private:
+	class Adapter;
+	class ChunkCompressStream;
+	class ChunkDecompressStream;
+
+	[[nodiscard]] size_type blockSize() const;
+
+	[[nodiscard]] static std::size_t numThreads(std::size_t num_threads,
+	                                            size_type   num_blocks);
+
+	/*!
+	 * @brief The adaptive mode state for compressing `uncompressed_size` bytes with
+	 * blocks compressed `parallelism` at a time, or null if not adaptive.
+	 */
+	[[nodiscard]] std::unique_ptr<Adapter> adapter(size_type   uncompressed_size,
+	                                               std::size_t parallelism) const;
+
+	// Streams of the chain in the order data passes through them
+	[[nodiscard]] std::vector<std::unique_ptr<Stream>> compressStages() const;
+
+	[[nodiscard]] std::vector<std::unique_ptr<Stream>> decompressStages() const;
+
+	/*!
+	 * @brief Writes the non-native format of the `uncompressed_size` bytes at `src` to
+	 * `dst`, which must have room for `compressBound(uncompressed_size)` bytes.
+	 *
+	 * @return The number of bytes written.
+	 */
+	size_type compressFrame(std::byte const* src, size_type uncompressed_size,
+	                        std::byte* dst) const;
+
+	/*!
+	 * @brief Size of the header of the non-native format.
+	 */
+	[[nodiscard]] size_type frameHeaderSize() const;
+
+	/*!
+	 * @brief Writes the header of the non-native format to `dst`, which must have room
+	 * for `frameHeaderSize()` bytes.
+	 *
+	 * @return The number of bytes written.
+	 */
+	size_type frameHeader(std::byte* dst, size_type uncompressed_size,
+	                      size_type block_size) const;
+
+	/*!
+	 * @brief Creates the chain of `types` that decompresses data compressed with
+	 * `parameters`, a copy of `settings` if it is such a chain and otherwise one with
+	 * default settings.
+	 */
+	[[nodiscard]] static std::unique_ptr<Compressor> frameChain(
+	    std::vector<CompressionAlgorithm> const& types,
+	    std::vector<std::vector<std::byte>> const& parameters, Compressor const* settings);
+
+	/*!
+	 * @brief Decompresses the non-native format with the settings of `settings`, or with
+	 * default settings and a single thread if null.
+	 */
+	static size_type decompressFrame(std::istream& in, std::ostream& out,
+	                                 Compressor const* settings);
+
+	static size_type decompressFrame(ReadBuffer& in, WriteBuffer& out,
+	                                 Compressor const* settings);
+
+	/*!
+	 * @brief Decompresses the non-native format at the start of `src` to `dst`, which
+	 * must have room for all of it.
+	 *
+	 * @return The number of bytes read from `src`.
+	 */
+	static size_type decompressFrame(std::byte const* src, size_type src_size,
+	                                 std::byte* dst, Compressor const* settings);
+
+	/*!
+	 * @brief Decompresses the bytes `[offset, offset + length)` of the non-native format
+	 * read through `in` to the memory returned by `dst(size)`, where `size` is the length
+	 * of the part of the range that exists.
+	 *
+	 * @return The number of bytes written.
+	 */
+	template <class Reader, class Dst>
+	size_type readRange(Reader& in, size_type offset, size_type length, Dst dst) const;
+
+	// What `compressAsync` and `decompressAsync` run
+	[[nodiscard]] std::vector<std::byte> compressVector(std::vector<std::byte> const& in,
+	                                                    bool native) const;
+
+	[[nodiscard]] std::vector<std::byte> decompressVector(
+	    std::vector<std::byte> const& in, bool native) const;
+
+	/*!
+	 * @brief Passes `src` through this compressor only.
+	 *
+	 * @return The compressed size.
+	 */
+	size_type compressChecked(std::byte const* src, size_type src_size, std::byte* dst,
+	                          size_type dst_cap) const;
+
+	/*!
+	 * @brief Reverses `compressChecked`.
+	 *
+	 * @return The decompressed size.
+	 */
+	size_type decompressChecked(std::byte const* src, size_type src_size, std::byte* dst,
+	                            size_type dst_cap) const;
+
+	/*!
+	 * @brief Passes `src` through the whole chain and writes the result to `dst`. The
+	 * intermediate results are ping-ponged between `a` and `b` (each of size `cap`),
+	 * which are only used by chains with more than one compressor.
+	 *
+	 * @return The compressed size.
+	 */
+	size_type compressBlock(std::byte const* src, size_type src_size, std::byte* dst,
+	                        size_type dst_cap, std::byte* a, std::byte* b,
+	                        size_type cap) const;
+
+	/*!
+	 * @brief Inverse of `compressBlock`, the result is written to `dst`. The buffers `a`
+	 * and `b` are only used by chains with more than one compressor.
+	 */
+	void decompressBlock(std::byte const* src, size_type src_size, std::byte* dst,
+	                     size_type uncompressed_size, std::byte* a, std::byte* b,
+	                     size_type cap) const;
+
  private:
 	std::unique_ptr<Compressor> next_;
 };
@@ -0,0 +1,157 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_COMPRESSION_DELTA_HPP
+#define UFO_COMPRESSION_DELTA_HPP
+
+// UFO
+#include <ufo/compression/algorithm.hpp>
+#include <ufo/compression/compressor.hpp>
+
+// STL
+#include <cstddef>
+#include <vector>
+
+namespace ufo
+{
+/*!
+ * @brief Filter that replaces each element of an array of `element_size` byte integers
+ * (1, 2, 4, or 8) by its difference to the previous one. Does not compress on its own,
+ * but turns monotone or slowly varying values, such as Morton codes, indices, and
+ * timestamps, into small numbers that a compressor chained after it handles far better.
+ *
+ * Differences wrap around, so any data is restored exactly. Floats are differenced as
+ * integers of the same width, which works for values of the same sign, see
+ * `CompressorXOR` otherwise. Bytes after the last whole element are left as they are.
+ * Uses SSE2 when compiled for it.
+ */
+struct CompressorDELTA : public Compressor {
+	std::size_t element_size = 4;
+
+	CompressorDELTA() noexcept              = default;
+	CompressorDELTA(CompressorDELTA const&) = default;
+	CompressorDELTA(CompressorDELTA&&)      = default;
+
+	CompressorDELTA(std::size_t element_size) : element_size(element_size) {}
+
+	~CompressorDELTA() override = default;
+
+	CompressorDELTA& operator=(CompressorDELTA const&) = default;
+	CompressorDELTA& operator=(CompressorDELTA&&)      = default;
+
+	[[nodiscard]] CompressionAlgorithm type() const noexcept override
+	{
+		return CompressionAlgorithm::DELTA;
+	}
+
+	using Compressor::compress;
+	using Compressor::decompress;
+
+ protected:
+	[[nodiscard]] size_type maxSizeImpl() const override;
+
+	[[nodiscard]] size_type compressBoundImpl(size_type uncompressed_size) const override;
+
+	size_type compress(std::byte const* src, std::byte* dst, size_type src_size,
+	                   size_type dst_cap) const override;
+
+	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
+	                     size_type dst_cap) const override;
+
+	[[nodiscard]] std::vector<std::byte> parameters() const override;
+
+	void setParameters(std::byte const* data, size_type size) override;
+
+	[[nodiscard]] CompressorDELTA* clone() const override
+	{
+		return new CompressorDELTA(*this);
+	}
+};
+
+/*!
+ * @brief Filter like `CompressorDELTA` that XORs each element with the previous one
+ * instead of subtracting it.
+ *
+ * Suits floats better, as values close to each other share their sign, exponent, and
+ * high mantissa bits, which XOR to zero regardless of sign.
+ */
+struct CompressorXOR : public Compressor {
+	std::size_t element_size = 4;
+
+	CompressorXOR() noexcept            = default;
+	CompressorXOR(CompressorXOR const&) = default;
+	CompressorXOR(CompressorXOR&&)      = default;
+
+	CompressorXOR(std::size_t element_size) : element_size(element_size) {}
+
+	~CompressorXOR() override = default;
+
+	CompressorXOR& operator=(CompressorXOR const&) = default;
+	CompressorXOR& operator=(CompressorXOR&&)      = default;
+
+	[[nodiscard]] CompressionAlgorithm type() const noexcept override
+	{
+		return CompressionAlgorithm::XOR;
+	}
+
+	using Compressor::compress;
+	using Compressor::decompress;
+
+ protected:
+	[[nodiscard]] size_type maxSizeImpl() const override;
+
+	[[nodiscard]] size_type compressBoundImpl(size_type uncompressed_size) const override;
+
+	size_type compress(std::byte const* src, std::byte* dst, size_type src_size,
+	                   size_type dst_cap) const override;
+
+	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
+	                     size_type dst_cap) const override;
+
+	[[nodiscard]] std::vector<std::byte> parameters() const override;
+
+	void setParameters(std::byte const* data, size_type size) override;
+
+	[[nodiscard]] CompressorXOR* clone() const override { return new CompressorXOR(*this); }
+};
+}  // namespace ufo
+
+#endif  // UFO_COMPRESSION_DELTA_HPP
\ No newline at end of file
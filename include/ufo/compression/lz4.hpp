@@ -48,13 +48,60 @@
 
 // STL
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace ufo
 {
+/*!
+ * @brief An LZ4 dictionary, data that compressed data may refer to as if it came right
+ * before it.
+ *
+ * Any data similar to what is compressed works, LZ4 only uses the last 64 KB. A
+ * dictionary trained by `ZSTDDictionary::train` is a good choice. The dictionary is
+ * shared between copies, so copying it is cheap. Data compressed with a dictionary can
+ * only be decompressed with the same dictionary, which is identified by `id()`.
+ */
+class LZ4Dictionary
+{
+ public:
+	// No dictionary
+	LZ4Dictionary() noexcept = default;
+
+	/*!
+	 * @brief Uses the last 64 KB of `data`.
+	 */
+	explicit LZ4Dictionary(std::vector<std::byte> data);
+
+	[[nodiscard]] explicit operator bool() const noexcept { return nullptr != impl_; }
+
+	/*!
+	 * @brief Checksum of the data, stored in data compressed with this dictionary. 0 if
+	 * none.
+	 */
+	[[nodiscard]] std::uint32_t id() const noexcept;
+
+	[[nodiscard]] std::vector<std::byte> const& data() const;
+
+ private:
+	friend struct CompressorLZ4;
+	friend class LZ4MessageEncoder;
+	friend class LZ4MessageDecoder;
+
+	struct Impl;
+
+	std::shared_ptr<Impl> impl_;
+};
+
 struct CompressorLZ4 : public Compressor {
 	int acceleration      = 1;
 	int compression_level = 0;
 
+	// Used by `compress` and required by `decompress` when set
+	LZ4Dictionary dictionary;
+
 	CompressorLZ4() noexcept            = default;
 	CompressorLZ4(CompressorLZ4 const&) = default;
 	CompressorLZ4(CompressorLZ4&&)      = default;
@@ -64,6 +111,13 @@ struct CompressorLZ4 : public Compressor {
 	{
 	}
 
+	CompressorLZ4(int acceleration, int compression_level, LZ4Dictionary dictionary)
+	    : acceleration(acceleration)
+	    , compression_level(compression_level)
+	    , dictionary(std::move(dictionary))
+	{
+	}
+
 	~CompressorLZ4() override = default;
 
 	CompressorLZ4& operator=(CompressorLZ4 const&) = default;
@@ -91,8 +145,105 @@ struct CompressorLZ4 : public Compressor {
 	                                   size_type src_size,
 	                                   size_type dst_cap) const override;
 
+	[[nodiscard]] std::unique_ptr<Stream> compressStream() const override;
+
+	[[nodiscard]] std::unique_ptr<Stream> decompressStream() const override;
+
+	[[nodiscard]] int numLevels() const override;
+
+	[[nodiscard]] int level() const override;
+
+	void setLevel(int level) override;
+
+	[[nodiscard]] std::vector<std::byte> parameters() const override;
+
+	void setParameters(std::byte const* data, size_type size) override;
+
 	[[nodiscard]] CompressorLZ4* clone() const override { return new CompressorLZ4(*this); }
 };
+
+/*!
+ * @brief Compresses a sequence of messages, such as the updates sent on a channel, where
+ * each message refers to the last 64 KB of the messages before it.
+ *
+ * Small messages that are similar to the ones before them compress far better than
+ * they would on their own. The messages have to be decompressed in the same order by
+ * an `LZ4MessageDecoder` with the same dictionary. Not thread-safe.
+ */
+class LZ4MessageEncoder
+{
+ public:
+	using size_type = Compressor::size_type;
+
+	explicit LZ4MessageEncoder(int acceleration = 1, LZ4Dictionary dictionary = {});
+
+	LZ4MessageEncoder(LZ4MessageEncoder&&) noexcept;
+
+	~LZ4MessageEncoder();
+
+	LZ4MessageEncoder& operator=(LZ4MessageEncoder&&) noexcept;
+
+	/*!
+	 * @brief Upper bound of the compressed size of a message of `size` bytes.
+	 */
+	[[nodiscard]] static size_type compressBound(size_type size);
+
+	/*!
+	 * @brief Compresses the `size` bytes at `src` as the next message and writes it to
+	 * `dst`, which has room for `dst_cap` bytes.
+	 *
+	 * @return The compressed size.
+	 */
+	size_type compress(std::byte const* src, size_type size, std::byte* dst,
+	                   size_type dst_cap);
+
+	/*!
+	 * @brief Forgets the previous messages, the next message starts a new sequence.
+	 */
+	void reset();
+
+ private:
+	struct State;
+
+	std::unique_ptr<State> state_;
+};
+
+/*!
+ * @brief Decompresses the messages of an `LZ4MessageEncoder`, in the order they were
+ * compressed. Not thread-safe.
+ */
+class LZ4MessageDecoder
+{
+ public:
+	using size_type = Compressor::size_type;
+
+	explicit LZ4MessageDecoder(LZ4Dictionary dictionary = {});
+
+	LZ4MessageDecoder(LZ4MessageDecoder&&) noexcept;
+
+	~LZ4MessageDecoder();
+
+	LZ4MessageDecoder& operator=(LZ4MessageDecoder&&) noexcept;
+
+	/*!
+	 * @brief Decompresses the next message, `size` bytes at `src`, to `dst`, which has
+	 * room for `dst_cap` bytes.
+	 *
+	 * @return The decompressed size.
+	 */
+	size_type decompress(std::byte const* src, size_type size, std::byte* dst,
+	                     size_type dst_cap);
+
+	/*!
+	 * @brief Forgets the previous messages, like `LZ4MessageEncoder::reset`.
+	 */
+	void reset();
+
+ private:
+	struct State;
+
+	std::unique_ptr<State> state_;
+};
 }  // namespace ufo
 
 #endif  // UFO_COMPRESSION_LZ4_HPP
\ No newline at end of file
@@ -54,10 +54,20 @@
 namespace ufo
 {
 struct CompressorLZF : public Compressor {
+	static constexpr int MIN_HASH_LOG = 10;
+	static constexpr int MAX_HASH_LOG = 18;
+
+	// Log2 of the number of hash table entries (LZF's HLOG). Smaller tables are faster
+	// for small blocks, larger ones compress large blocks better. Clamped to
+	// [MIN_HASH_LOG, MAX_HASH_LOG]. Decompression does not depend on it.
+	int hash_log = 16;
+
 	CompressorLZF() noexcept            = default;
 	CompressorLZF(CompressorLZF const&) = default;
 	CompressorLZF(CompressorLZF&&)      = default;
 
+	CompressorLZF(int hash_log) : hash_log(hash_log) {}
+
 	~CompressorLZF() override = default;
 
 	CompressorLZF& operator=(CompressorLZF const&) = default;
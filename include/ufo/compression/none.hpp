@@ -82,6 +82,10 @@ struct CompressorNONE : public Compressor {
 	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
 	                     size_type dst_cap) const override;
 
+	[[nodiscard]] std::unique_ptr<Stream> compressStream() const override;
+
+	[[nodiscard]] std::unique_ptr<Stream> decompressStream() const override;
+
 	[[nodiscard]] CompressorNONE* clone() const override
 	{
 		return new CompressorNONE(*this);
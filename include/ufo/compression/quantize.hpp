@@ -0,0 +1,128 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_COMPRESSION_QUANTIZE_HPP
+#define UFO_COMPRESSION_QUANTIZE_HPP
+
+// UFO
+#include <ufo/compression/algorithm.hpp>
+#include <ufo/compression/compressor.hpp>
+
+// STL
+#include <cstddef>
+#include <vector>
+
+namespace ufo
+{
+/*!
+ * @brief Lossy filter that maps an array of floats in `[min_value, max_value]` to
+ * `bits` bit integers (8 or 16), evenly spaced over the range, which quarters or halves
+ * the data before it reaches the compressors chained after it. Decompressing maps the
+ * integers back to the floats they stand for.
+ *
+ * Values outside the range are clamped to it, and NaN becomes `min_value`. Values in
+ * the range are off by at most `maxError()`, give or take float rounding. Bytes after
+ * the last whole float are left as they are. Uses SSE2 when compiled for it.
+ */
+struct CompressorQUANTIZE : public Compressor {
+	float min_value = 0.0f;
+	float max_value = 1.0f;
+	int   bits      = 8;
+
+	CompressorQUANTIZE() noexcept                 = default;
+	CompressorQUANTIZE(CompressorQUANTIZE const&) = default;
+	CompressorQUANTIZE(CompressorQUANTIZE&&)      = default;
+
+	CompressorQUANTIZE(float min_value, float max_value, int bits = 8)
+	    : min_value(min_value), max_value(max_value), bits(bits)
+	{
+	}
+
+	~CompressorQUANTIZE() override = default;
+
+	CompressorQUANTIZE& operator=(CompressorQUANTIZE const&) = default;
+	CompressorQUANTIZE& operator=(CompressorQUANTIZE&&)      = default;
+
+	/*!
+	 * @brief Creates a compressor for `[min_value, max_value]` with the fewest bits such
+	 * that `maxError() <= error_bound`. Throws if 16 bits are not enough.
+	 */
+	[[nodiscard]] static CompressorQUANTIZE withErrorBound(float min_value,
+	                                                       float max_value,
+	                                                       float error_bound);
+
+	/*!
+	 * @brief Largest difference between a value in the range and its decompressed value,
+	 * half the distance between two consecutive quantized values.
+	 */
+	[[nodiscard]] float maxError() const noexcept;
+
+	[[nodiscard]] CompressionAlgorithm type() const noexcept override
+	{
+		return CompressionAlgorithm::QUANTIZE;
+	}
+
+	using Compressor::compress;
+	using Compressor::decompress;
+
+ protected:
+	[[nodiscard]] size_type maxSizeImpl() const override;
+
+	[[nodiscard]] size_type compressBoundImpl(size_type uncompressed_size) const override;
+
+	size_type compress(std::byte const* src, std::byte* dst, size_type src_size,
+	                   size_type dst_cap) const override;
+
+	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
+	                     size_type dst_cap) const override;
+
+	[[nodiscard]] std::vector<std::byte> parameters() const override;
+
+	void setParameters(std::byte const* data, size_type size) override;
+
+	[[nodiscard]] CompressorQUANTIZE* clone() const override
+	{
+		return new CompressorQUANTIZE(*this);
+	}
+};
+}  // namespace ufo
+
+#endif  // UFO_COMPRESSION_QUANTIZE_HPP
\ No newline at end of file
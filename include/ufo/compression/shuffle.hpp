@@ -0,0 +1,160 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_COMPRESSION_SHUFFLE_HPP
+#define UFO_COMPRESSION_SHUFFLE_HPP
+
+// UFO
+#include <ufo/compression/algorithm.hpp>
+#include <ufo/compression/compressor.hpp>
+
+// STL
+#include <cstddef>
+#include <vector>
+
+namespace ufo
+{
+/*!
+ * @brief Filter that transposes the bytes of an array of `element_size` byte elements,
+ * such that the first bytes of all elements come first, then the second bytes, and so
+ * on. Does not compress on its own, but chained in front of a compressor it groups
+ * bytes that are alike (e.g., the exponents of floats or the high bytes of integers)
+ * and makes them far more compressible.
+ *
+ * Bytes after the last whole element are left as they are. Uses SSE2 or AVX2 when
+ * compiled for them.
+ */
+struct CompressorSHUFFLE : public Compressor {
+	std::size_t element_size = 4;
+
+	CompressorSHUFFLE() noexcept                = default;
+	CompressorSHUFFLE(CompressorSHUFFLE const&) = default;
+	CompressorSHUFFLE(CompressorSHUFFLE&&)      = default;
+
+	CompressorSHUFFLE(std::size_t element_size) : element_size(element_size) {}
+
+	~CompressorSHUFFLE() override = default;
+
+	CompressorSHUFFLE& operator=(CompressorSHUFFLE const&) = default;
+	CompressorSHUFFLE& operator=(CompressorSHUFFLE&&)      = default;
+
+	[[nodiscard]] CompressionAlgorithm type() const noexcept override
+	{
+		return CompressionAlgorithm::SHUFFLE;
+	}
+
+	using Compressor::compress;
+	using Compressor::decompress;
+
+ protected:
+	[[nodiscard]] size_type maxSizeImpl() const override;
+
+	[[nodiscard]] size_type compressBoundImpl(size_type uncompressed_size) const override;
+
+	size_type compress(std::byte const* src, std::byte* dst, size_type src_size,
+	                   size_type dst_cap) const override;
+
+	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
+	                     size_type dst_cap) const override;
+
+	[[nodiscard]] std::vector<std::byte> parameters() const override;
+
+	void setParameters(std::byte const* data, size_type size) override;
+
+	[[nodiscard]] CompressorSHUFFLE* clone() const override
+	{
+		return new CompressorSHUFFLE(*this);
+	}
+};
+
+/*!
+ * @brief Filter like `CompressorSHUFFLE` that transposes bits instead of bytes: the
+ * first bits of all elements come first, then the second bits, and so on.
+ *
+ * Better than shuffling bytes for data where only some bits of each byte vary, such as
+ * small integers or quantized values. Elements after the last whole group of eight are
+ * left as they are.
+ */
+struct CompressorBITSHUFFLE : public Compressor {
+	std::size_t element_size = 4;
+
+	CompressorBITSHUFFLE() noexcept                   = default;
+	CompressorBITSHUFFLE(CompressorBITSHUFFLE const&) = default;
+	CompressorBITSHUFFLE(CompressorBITSHUFFLE&&)      = default;
+
+	CompressorBITSHUFFLE(std::size_t element_size) : element_size(element_size) {}
+
+	~CompressorBITSHUFFLE() override = default;
+
+	CompressorBITSHUFFLE& operator=(CompressorBITSHUFFLE const&) = default;
+	CompressorBITSHUFFLE& operator=(CompressorBITSHUFFLE&&)      = default;
+
+	[[nodiscard]] CompressionAlgorithm type() const noexcept override
+	{
+		return CompressionAlgorithm::BITSHUFFLE;
+	}
+
+	using Compressor::compress;
+	using Compressor::decompress;
+
+ protected:
+	[[nodiscard]] size_type maxSizeImpl() const override;
+
+	[[nodiscard]] size_type compressBoundImpl(size_type uncompressed_size) const override;
+
+	size_type compress(std::byte const* src, std::byte* dst, size_type src_size,
+	                   size_type dst_cap) const override;
+
+	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
+	                     size_type dst_cap) const override;
+
+	[[nodiscard]] std::vector<std::byte> parameters() const override;
+
+	void setParameters(std::byte const* data, size_type size) override;
+
+	[[nodiscard]] CompressorBITSHUFFLE* clone() const override
+	{
+		return new CompressorBITSHUFFLE(*this);
+	}
+};
+}  // namespace ufo
+
+#endif  // UFO_COMPRESSION_SHUFFLE_HPP
\ No newline at end of file
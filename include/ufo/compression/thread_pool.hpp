@@ -0,0 +1,226 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_COMPRESSION_THREAD_POOL_HPP
+#define UFO_COMPRESSION_THREAD_POOL_HPP
+
+// STL
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ufo
+{
+/*!
+ * @brief Priority of tasks run on a `ThreadPool`. Threads always take the most urgent
+ * queued task, so a task never waits for queued tasks of lower priority, only for those
+ * already running.
+ */
+enum class Priority : std::uint8_t { LOW = 0, NORMAL = 1, HIGH = 2 };
+
+/*!
+ * @brief Work-stealing thread pool.
+ *
+ * Each thread has a queue of its own, where tasks submitted from that thread go and
+ * from which it takes the newest task first. Tasks submitted from outside the pool go
+ * to a shared queue. Threads out of work take the oldest task of the shared queue, and
+ * otherwise of another thread's queue. Each queue is split by `Priority`, the most urgent
+ * tasks being taken first.
+ *
+ * `shared()` is the pool all compressors run on, which is configured once per process.
+ */
+class ThreadPool
+{
+ public:
+	struct Config {
+		std::size_t num_threads = std::thread::hardware_concurrency();
+		// CPUs the threads are pinned to, thread `i` to `cpus[i % cpus.size()]`. Not
+		// pinned if empty, and only supported on Linux.
+		std::vector<int> cpus;
+	};
+
+	explicit ThreadPool(std::size_t num_threads = std::thread::hardware_concurrency());
+
+	explicit ThreadPool(Config config);
+
+	ThreadPool(ThreadPool const&) = delete;
+
+	~ThreadPool();
+
+	ThreadPool& operator=(ThreadPool const&) = delete;
+
+	/*!
+	 * @brief The pool shared by all compressors, started on first use.
+	 */
+	[[nodiscard]] static ThreadPool& shared();
+
+	/*!
+	 * @brief Configures the shared pool, which has to be done before it is first used.
+	 * Throws `std::logic_error` if it has already started.
+	 */
+	static void configure(Config config);
+
+	[[nodiscard]] std::size_t size() const noexcept { return threads_.size(); }
+
+	/*!
+	 * @brief Runs `f` on the pool with the priority of the calling task, or
+	 * `Priority::NORMAL` if not called from a task of this pool.
+	 */
+	template <class F>
+	std::future<std::invoke_result_t<std::decay_t<F>>> submit(F&& f)
+	{
+		return submit(priority(), std::forward<F>(f));
+	}
+
+	template <class F>
+	std::future<std::invoke_result_t<std::decay_t<F>>> submit(Priority priority, F&& f)
+	{
+		using R = std::invoke_result_t<std::decay_t<F>>;
+
+		auto task   = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+		auto future = task->get_future();
+		enqueue(priority, [task]() { (*task)(); });
+		return future;
+	}
+
+	/*!
+	 * @brief Waits for `future`. A thread of the pool runs other tasks in the meantime,
+	 * such that tasks waiting on tasks cannot use up all threads, and otherwise sleeps
+	 * until a task finishes or one it may run is queued. Only tasks at least as urgent as
+	 * the waiting one are run, so a waiting task is not held up by less urgent work; it
+	 * must therefore not wait on tasks of lower priority. On a thread of the pool,
+	 * `future` has to be made ready by a task of the pool.
+	 */
+	template <class T>
+	void wait(std::future<T> const& future)
+	{
+		if (!current()) {
+			future.wait();
+			return;
+		}
+
+		auto min   = static_cast<std::size_t>(priority());
+		auto ready = [&future]() {
+			return std::future_status::ready == future.wait_for(std::chrono::seconds(0));
+		};
+		auto runnable = [this, min]() {
+			for (auto p = min; NUM_PRIORITIES > p; ++p) {
+				if (0 < num_tasks_[p]) {
+					return true;
+				}
+			}
+			return false;
+		};
+
+		while (!ready()) {
+			if (runOne(static_cast<Priority>(min))) {
+				continue;
+			}
+
+			std::unique_lock lock(mutex_);
+			++num_waiting_;
+			wait_cv_.wait(lock, [&]() { return ready() || runnable(); });
+			--num_waiting_;
+		}
+	}
+
+	/*!
+	 * @brief The priority of the task running on the calling thread, or
+	 * `Priority::NORMAL` if the calling thread does not belong to this pool.
+	 */
+	[[nodiscard]] Priority priority() const noexcept;
+
+ private:
+	using Task = std::function<void()>;
+
+	static constexpr std::size_t NUM_PRIORITIES = 3;
+
+	// One deque per priority
+	using Tasks = std::array<std::deque<Task>, NUM_PRIORITIES>;
+
+	using Counts = std::array<std::atomic<std::size_t>, NUM_PRIORITIES>;
+
+	struct Queue {
+		Tasks      tasks;
+		std::mutex mutex;
+	};
+
+	// The queue of the calling thread if it belongs to this pool, otherwise null
+	[[nodiscard]] Queue* current() const noexcept;
+
+	void enqueue(Priority priority, Task task);
+
+	// Runs the most urgent task of at least priority `min`, returns false if there was none
+	bool runOne(Priority min = Priority::LOW);
+
+	// Takes a task of priority `p`, returns false if there was none
+	bool take(std::size_t p, Task& task);
+
+	void run(std::size_t index, std::vector<int> const& cpus);
+
+ private:
+	std::vector<std::unique_ptr<Queue>> queues_;
+	std::vector<std::thread>            threads_;
+	// Tasks submitted from outside the pool
+	Tasks                               tasks_;
+	// Number of queued tasks per priority
+	Counts                              num_tasks_{};
+	std::mutex                          mutex_;
+	std::condition_variable             cv_;
+	bool                                done_ = false;
+	// Threads of the pool sleeping in `wait`, woken when a task finishes or is queued
+	std::size_t                         num_waiting_{};
+	std::condition_variable             wait_cv_;
+};
+}  // namespace ufo
+
+#endif  // UFO_COMPRESSION_THREAD_POOL_HPP
\ No newline at end of file
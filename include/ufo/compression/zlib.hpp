@@ -85,6 +85,16 @@ struct CompressorZLIB : public Compressor {
 	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
 	                     size_type dst_cap) const override;
 
+	[[nodiscard]] std::unique_ptr<Stream> compressStream() const override;
+
+	[[nodiscard]] std::unique_ptr<Stream> decompressStream() const override;
+
+	[[nodiscard]] int numLevels() const override;
+
+	[[nodiscard]] int level() const override;
+
+	void setLevel(int level) override;
+
 	[[nodiscard]] CompressorZLIB* clone() const override
 	{
 		return new CompressorZLIB(*this);
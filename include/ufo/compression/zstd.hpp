@@ -50,18 +50,77 @@
 // STL
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace ufo
 {
+/*!
+ * @brief A zstd dictionary, which improves the compression of small blocks that are
+ * similar to the samples it was trained on.
+ *
+ * The dictionary is digested once per compression level and shared between copies, so
+ * copying it is cheap. Data compressed with a dictionary can only be decompressed with
+ * the same dictionary, which is identified by `id()`.
+ */
+class ZSTDDictionary
+{
+ public:
+	// No dictionary
+	ZSTDDictionary() noexcept = default;
+
+	/*!
+	 * @brief Uses `data`, a dictionary created by `train` or by the zstd command line tool.
+	 */
+	explicit ZSTDDictionary(std::vector<std::byte> data);
+
+	/*!
+	 * @brief Trains a dictionary of at most `capacity` bytes on the samples stored back to
+	 * back at `samples`, where `sample_sizes` holds the size of each sample.
+	 *
+	 * Training needs many samples (a hundred or more), each typically the size of the
+	 * blocks the dictionary is used for.
+	 */
+	[[nodiscard]] static ZSTDDictionary train(std::byte const*                samples,
+	                                          std::vector<std::size_t> const& sample_sizes,
+	                                          std::size_t capacity = 110 * 1024);
+
+	[[nodiscard]] explicit operator bool() const noexcept { return nullptr != impl_; }
+
+	/*!
+	 * @brief Identifier stored in data compressed with this dictionary, 0 if none.
+	 */
+	[[nodiscard]] std::uint32_t id() const noexcept;
+
+	[[nodiscard]] std::vector<std::byte> const& data() const;
+
+ private:
+	friend struct CompressorZSTD;
+
+	struct Impl;
+
+	std::shared_ptr<Impl> impl_;
+};
+
 struct CompressorZSTD : public Compressor {
 	int compression_level;
 
+	// Used by `compress` and required by `decompress` when set
+	ZSTDDictionary dictionary;
+
 	CompressorZSTD() noexcept;
 	CompressorZSTD(CompressorZSTD const&) = default;
 	CompressorZSTD(CompressorZSTD&&)      = default;
 
 	CompressorZSTD(int compression_level) : compression_level(compression_level) {}
 
+	CompressorZSTD(int compression_level, ZSTDDictionary dictionary)
+	    : compression_level(compression_level), dictionary(std::move(dictionary))
+	{
+	}
+
 	~CompressorZSTD() override = default;
 
 	CompressorZSTD& operator=(CompressorZSTD const&) = default;
@@ -86,6 +145,20 @@ struct CompressorZSTD : public Compressor {
 	size_type decompress(std::byte const* src, std::byte* dst, size_type src_size,
 	                     size_type dst_cap) const override;
 
+	[[nodiscard]] std::unique_ptr<Stream> compressStream() const override;
+
+	[[nodiscard]] std::unique_ptr<Stream> decompressStream() const override;
+
+	[[nodiscard]] int numLevels() const override;
+
+	[[nodiscard]] int level() const override;
+
+	void setLevel(int level) override;
+
+	[[nodiscard]] std::vector<std::byte> parameters() const override;
+
+	void setParameters(std::byte const* data, size_type size) override;
+
 	[[nodiscard]] CompressorZSTD* clone() const override
 	{
 		return new CompressorZSTD(*this);
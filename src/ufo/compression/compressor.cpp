@@ -0,0 +1,2733 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//  UFO
+#include <ufo/compression/compressor.hpp>
+#include <ufo/compression/delta.hpp>
+#include <ufo/compression/lz4.hpp>
+#include <ufo/compression/lzf.hpp>
+#include <ufo/compression/none.hpp>
+#include <ufo/compression/quantize.hpp>
+#include <ufo/compression/rle.hpp>
+#include <ufo/compression/shuffle.hpp>
+#include <ufo/compression/thread_pool.hpp>
+#include <ufo/compression/zlib.hpp>
+#include <ufo/compression/zstd.hpp>
+
+// STL
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// POSIX
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ufo
+{
+namespace
+{
+/*
+ * Non-native format (all values in host byte order):
+ *
+ *   Header:
+ *     std::uint32_t  magic
+ *     std::uint32_t  version
+ *     std::uint32_t  chain length N
+ *     N times:
+ *       std::uint32_t  algorithm
+ *       std::uint32_t  parameter size P
+ *       std::byte      parameters[P]
+ *     std::uint64_t  uncompressed size
+ *     std::uint64_t  block size
+ *
+ *   Blocks, each:
+ *     std::uint64_t  compressed size
+ *     std::uint64_t  uncompressed size
+ *     std::byte      data[compressed size]
+ *
+ *   Index:
+ *     std::uint64_t  offset[number of blocks]
+ *     std::uint64_t  index offset
+ *     std::uint32_t  index magic
+ *
+ * All offsets are relative to the start of the header. Every block except the last
+ * holds exactly `block size` uncompressed bytes, so block `i` decompresses to offset
+ * `i * block size`. The parameters are the settings decompression depends on, see
+ * `Compressor::parameters`. Version 2 is the same without parameter sizes and parameters.
+ */
+constexpr std::uint32_t FRAME_MAGIC   = 0x43464F55;  // "UFOC"
+constexpr std::uint32_t FRAME_VERSION = 3;
+constexpr std::uint32_t INDEX_MAGIC   = 0x58464F55;  // "UFOX"
+
+// Parameters are a few settings, anything larger is corrupt
+constexpr std::uint32_t MAX_PARAMETER_SIZE = 4096;
+
+// A chain is a few compressors, anything longer is corrupt
+constexpr std::uint32_t MAX_CHAIN_SIZE = 64;
+
+// Largest block the non-native format writes, anything larger is corrupt. Each thread
+// decompressing holds a few buffers of this size.
+constexpr std::uint64_t MAX_BLOCK_SIZE = std::uint64_t(1) << 30;
+
+constexpr std::size_t BLOCK_HEADER_SIZE  = 2 * sizeof(std::uint64_t);
+constexpr std::size_t INDEX_TRAILER_SIZE = sizeof(std::uint64_t) + sizeof(std::uint32_t);
+
+/*
+ * Native format of compressors without a streaming format of their own, see
+ * `Compressor::compressStream`. Chunks, each:
+ *     std::uint32_t  compressed size
+ *     std::uint32_t  uncompressed size
+ *     std::byte      data[compressed size]
+ * followed by an empty chunk (both sizes 0) marking the end.
+ */
+constexpr std::size_t CHUNK_SIZE        = 64 * 1024;
+constexpr std::size_t CHUNK_HEADER_SIZE = 2 * sizeof(std::uint32_t);
+
+/*
+ * Archive of a directory, see `Compressor::compress(path, path)`:
+ *
+ *   Header:
+ *     std::uint32_t  magic
+ *     std::uint32_t  version
+ *
+ *   Files, each a non-native frame
+ *
+ *   Index:
+ *     std::uint64_t  number of entries
+ *     Entries, each:
+ *       std::uint32_t  type (0 file, 1 directory)
+ *       std::uint32_t  path size P
+ *       char           path[P]
+ *       std::uint64_t  offset
+ *       std::uint64_t  compressed size
+ *       std::uint64_t  uncompressed size
+ *     std::uint64_t  index offset
+ *     std::uint32_t  index magic
+ *
+ * Paths are relative to the archived directory and use '/' as separator. Offsets are
+ * relative to the start of the header, the offset and sizes of a directory are 0.
+ */
+constexpr std::uint32_t ARCHIVE_MAGIC       = 0x41464F55;  // "UFOA"
+constexpr std::uint32_t ARCHIVE_VERSION     = 1;
+constexpr std::uint32_t ARCHIVE_INDEX_MAGIC = 0x49464F55;  // "UFOI"
+
+constexpr std::size_t ARCHIVE_HEADER_SIZE = 2 * sizeof(std::uint32_t);
+
+// Size of an index entry without its path
+constexpr std::size_t ARCHIVE_ENTRY_SIZE =
+    2 * sizeof(std::uint32_t) + 3 * sizeof(std::uint64_t);
+
+using size_type = Compressor::size_type;
+
+using Parameters = std::vector<std::byte>;
+
+// Size of the header of a chain of `chain_size` compressors, whose parameters take
+// `parameters_size` bytes together
+[[nodiscard]] constexpr size_type headerSize(size_type chain_size,
+                                             size_type parameters_size)
+{
+	return 3 * sizeof(std::uint32_t) + 2 * sizeof(std::uint64_t) +
+	       chain_size * 2 * sizeof(std::uint32_t) + parameters_size;
+}
+
+[[nodiscard]] size_type headerSize(std::vector<Parameters> const& parameters)
+{
+	size_type size{};
+	for (auto const& p : parameters) {
+		size += p.size();
+	}
+	return headerSize(parameters.size(), size);
+}
+
+[[nodiscard]] constexpr size_type indexSize(size_type num_blocks)
+{
+	return num_blocks * sizeof(std::uint64_t) + INDEX_TRAILER_SIZE;
+}
+
+[[nodiscard]] constexpr size_type numBlocks(size_type uncompressed_size,
+                                            size_type block_size)
+{
+	// Does not overflow for sizes close to the maximum, as read from a corrupt header
+	return uncompressed_size / block_size + (0 == uncompressed_size % block_size ? 0 : 1);
+}
+
+[[noreturn]] void corrupt(char const* what)
+{
+	throw std::runtime_error(std::string("ufo::Compressor: ") + what);
+}
+
+class StreamReader
+{
+ public:
+	explicit StreamReader(std::istream& in) : in_(in), start_(in.tellg()) {}
+
+	void read(void* dst, size_type count)
+	{
+		if (!in_.read(static_cast<char*>(dst), count)) {
+			corrupt("unexpected end of compressed data");
+		}
+	}
+
+	// Positions are relative to where the stream was, and only work if it is seekable
+	void seek(size_type pos)
+	{
+		if (!in_.seekg(start_ + static_cast<std::streamoff>(pos))) {
+			corrupt("unexpected end of compressed data");
+		}
+	}
+
+	[[nodiscard]] size_type position() const
+	{
+		return static_cast<size_type>(in_.tellg() - start_);
+	}
+
+	// Whether `seek` and `size` work
+	[[nodiscard]] bool seekable() const { return std::streampos(-1) != start_; }
+
+	[[nodiscard]] size_type size() const
+	{
+		auto pos = in_.tellg();
+		in_.seekg(0, std::ios::end);
+		auto end = in_.tellg();
+		in_.seekg(pos);
+		return static_cast<size_type>(end - start_);
+	}
+
+ private:
+	std::istream&  in_;
+	std::streampos start_;
+};
+
+class MemoryReader
+{
+ public:
+	MemoryReader(std::byte const* data, size_type size) : data_(data), size_(size) {}
+
+	void read(void* dst, size_type count)
+	{
+		if (size_ - pos_ < count) {
+			corrupt("unexpected end of compressed data");
+		}
+		std::memcpy(dst, data_ + pos_, count);
+		pos_ += count;
+	}
+
+	void seek(size_type pos)
+	{
+		if (size_ < pos) {
+			corrupt("unexpected end of compressed data");
+		}
+		pos_ = pos;
+	}
+
+	[[nodiscard]] size_type position() const noexcept { return pos_; }
+
+	[[nodiscard]] size_type size() const noexcept { return size_; }
+
+	[[nodiscard]] std::byte const* data() const noexcept { return data_; }
+
+ private:
+	std::byte const* data_;
+	size_type        size_;
+	size_type        pos_{};
+};
+
+template <class T>
+void writeValue(std::ostream& out, T const& value)
+{
+	out.write(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+template <class T, class Reader>
+[[nodiscard]] T readValue(Reader& in)
+{
+	T value;
+	in.read(&value, sizeof(value));
+	return value;
+}
+
+struct FrameHeader {
+	std::vector<CompressionAlgorithm> types;
+	std::vector<Parameters>           parameters;
+	std::unique_ptr<Compressor>       chain;
+	size_type                         uncompressed_size;
+	size_type                         block_size;
+	size_type                         num_blocks;
+	size_type                         size;
+
+	// Uncompressed size of block `i`
+	[[nodiscard]] size_type blockSize(size_type i) const
+	{
+		return std::min(block_size, uncompressed_size - i * block_size);
+	}
+
+	// Uncompressed size of the largest block
+	[[nodiscard]] size_type maxBlockSize() const
+	{
+		return std::min(block_size, uncompressed_size);
+	}
+
+	// Size of the buffers needed to hold any intermediate result of a block
+	[[nodiscard]] size_type cap() const
+	{
+		return std::max(maxBlockSize(), chain->compressBound(maxBlockSize(), true));
+	}
+};
+
+// Reads everything but `chain`, which depends on who is decompressing
+template <class Reader>
+[[nodiscard]] FrameHeader readHeader(Reader& in)
+{
+	if (FRAME_MAGIC != readValue<std::uint32_t>(in)) {
+		corrupt("not compressed by ufo::Compressor");
+	}
+	auto version = readValue<std::uint32_t>(in);
+	if (2 != version && FRAME_VERSION != version) {
+		throw std::runtime_error("ufo::Compressor: unsupported format version " +
+		                         std::to_string(version));
+	}
+
+	FrameHeader header;
+	auto        chain_size = readValue<std::uint32_t>(in);
+	if (0 == chain_size) {
+		corrupt("empty compressor chain");
+	} else if (MAX_CHAIN_SIZE < chain_size) {
+		corrupt("invalid compressor chain");
+	}
+	header.types.resize(chain_size);
+	header.parameters.resize(chain_size);
+	for (std::size_t i{}; header.types.size() > i; ++i) {
+		header.types[i] = static_cast<CompressionAlgorithm>(readValue<std::uint32_t>(in));
+		if (2 != version) {
+			auto size = readValue<std::uint32_t>(in);
+			if (MAX_PARAMETER_SIZE < size) {
+				corrupt("invalid compressor parameters");
+			}
+			if (0 < size) {
+				header.parameters[i].resize(size);
+				in.read(header.parameters[i].data(), size);
+			}
+		}
+	}
+
+	header.uncompressed_size = static_cast<size_type>(readValue<std::uint64_t>(in));
+	header.block_size        = static_cast<size_type>(readValue<std::uint64_t>(in));
+	if (0 == header.block_size || MAX_BLOCK_SIZE < header.block_size) {
+		corrupt("invalid block size");
+	}
+	header.num_blocks = numBlocks(header.uncompressed_size, header.block_size);
+	header.size       = headerSize(header.parameters);
+	if (2 == version) {
+		header.size -= header.types.size() * sizeof(std::uint32_t);
+	}
+	return header;
+}
+
+/*
+ * Throws if the frame of `header` cannot fit in the `size` bytes it is read from, before
+ * anything is allocated based on the header. Each block takes at least its own header.
+ */
+void checkHeader(FrameHeader const& header, size_type size)
+{
+	if (size < header.size ||
+	    (size - header.size) / BLOCK_HEADER_SIZE < header.num_blocks ||
+	    header.num_blocks < header.uncompressed_size / header.block_size) {
+		corrupt("corrupt frame header");
+	}
+}
+
+// Uncompressed size of the frame starting at `src`
+[[nodiscard]] size_type frameSize(std::byte const* src, size_type size)
+{
+	MemoryReader reader(src, size);
+	auto         header = readHeader(reader);
+	checkHeader(header, size);
+	return header.uncompressed_size;
+}
+
+/*
+ * Returns the offset of each block in the frame starting at the beginning of `in`,
+ * followed by the offset of the index. The index is used if the frame extends to the
+ * end of `in`, otherwise the blocks are walked.
+ */
+template <class Reader>
+[[nodiscard]] std::vector<std::uint64_t> readIndex(Reader& in, FrameHeader const& header)
+{
+	checkHeader(header, in.size());
+	std::vector<std::uint64_t> offsets(header.num_blocks + 1);
+
+	auto index_size = indexSize(header.num_blocks);
+	if (header.size + index_size <= in.size()) {
+		in.seek(in.size() - INDEX_TRAILER_SIZE);
+		auto index_offset = readValue<std::uint64_t>(in);
+		auto magic        = readValue<std::uint32_t>(in);
+		if (INDEX_MAGIC == magic && index_offset + index_size == in.size()) {
+			in.seek(index_offset);
+			in.read(offsets.data(), header.num_blocks * sizeof(std::uint64_t));
+			offsets.back() = index_offset;
+			return offsets;
+		}
+	}
+
+	in.seek(header.size);
+	for (size_type i{}; header.num_blocks > i; ++i) {
+		offsets[i] = in.position();
+		in.seek(in.position() + BLOCK_HEADER_SIZE + readValue<std::uint64_t>(in));
+	}
+	offsets.back() = in.position();
+	return offsets;
+}
+
+// Throws if blocks `[first, last)` are not within the frame of `size` bytes
+void checkIndex(std::vector<std::uint64_t> const& offsets, FrameHeader const& header,
+                size_type size, size_type first, size_type last)
+{
+	for (auto i = first; last > i; ++i) {
+		if (offsets[i] < header.size || offsets[i + 1] < offsets[i] ||
+		    size < offsets[i + 1]) {
+			corrupt("corrupt block index");
+		}
+	}
+}
+
+/*
+ * The compressed data of the block of `size` bytes (including its header) at `src`, and
+ * its size. Throws if the header does not match `uncompressed_size`.
+ */
+[[nodiscard]] std::pair<std::byte const*, size_type> blockData(
+    std::byte const* src, size_type size, size_type uncompressed_size)
+{
+	MemoryReader block(src, size);
+	auto compressed_size = static_cast<size_type>(readValue<std::uint64_t>(block));
+	if (size != BLOCK_HEADER_SIZE + compressed_size ||
+	    uncompressed_size != static_cast<size_type>(readValue<std::uint64_t>(block))) {
+		corrupt("corrupt block header");
+	}
+	return {src + BLOCK_HEADER_SIZE, compressed_size};
+}
+
+/*
+ * Uninitialized memory that is handed back to the calling thread when released, and
+ * handed out again by later requests on that thread. Each thread's memory grows to the
+ * most it has needed at once, after which (de)compressing no longer allocates.
+ */
+class ScratchBuffer
+{
+ public:
+	ScratchBuffer() = default;
+
+	explicit ScratchBuffer(size_type size)
+	{
+		if (0 == size) {
+			return;
+		}
+
+		auto& list = released();
+
+		// The smallest released buffer that is large enough
+		auto it = list.end();
+		for (auto i = list.begin(); list.end() != i; ++i) {
+			if (size <= i->size && (list.end() == it || i->size < it->size)) {
+				it = i;
+			}
+		}
+		if (list.end() != it) {
+			block_ = std::move(*it);
+			list.erase(it);
+			return;
+		}
+
+		// Otherwise replace the largest one, so the memory kept is bounded by what is needed
+		// at once rather than by the number of different sizes asked for
+		if (!list.empty()) {
+			list.erase(std::max_element(list.begin(), list.end(),
+			                            [](Block const& a, Block const& b) {
+				                            return a.size < b.size;
+			                            }));
+		}
+
+		block_.data.reset(new std::byte[size]);
+		block_.size = size;
+	}
+
+	ScratchBuffer(ScratchBuffer&& other) noexcept : block_(std::move(other.block_))
+	{
+		other.block_.size = 0;
+	}
+
+	~ScratchBuffer()
+	{
+		if (block_.data) {
+			try {
+				released().push_back(std::move(block_));
+			} catch (...) {
+				// Not kept then
+			}
+		}
+	}
+
+	ScratchBuffer& operator=(ScratchBuffer&& rhs) noexcept
+	{
+		std::swap(block_, rhs.block_);
+		return *this;
+	}
+
+	[[nodiscard]] std::byte* get() const noexcept { return block_.data.get(); }
+
+ private:
+	struct Block {
+		std::unique_ptr<std::byte[]> data;
+		size_type                    size{};
+	};
+
+	[[nodiscard]] static std::vector<Block>& released()
+	{
+		thread_local std::vector<Block> list;
+		return list;
+	}
+
+ private:
+	Block block_;
+};
+
+struct BlockSlot {
+	ScratchBuffer     src;
+	ScratchBuffer     dst;
+	ScratchBuffer     a;
+	ScratchBuffer     b;
+	size_type         src_size{};
+	size_type         dst_size{};
+	// Used by `pipelineBlocks`: the block number, and the input of the next stage
+	size_type         index{};
+	std::byte const*  in{};
+	size_type         in_size{};
+	// Used by the adaptive mode: the chain compressing the block, and the time taken by
+	// its slowest stage
+	Compressor const* chain{};
+	double            seconds{};
+
+	BlockSlot(size_type src_cap, size_type dst_cap, size_type scratch_cap)
+	    : src(src_cap), dst(dst_cap), a(scratch_cap), b(scratch_cap)
+	{
+	}
+
+	// Output of stage `i` of a pipeline that is not the last
+	[[nodiscard]] std::byte* scratch(std::size_t i) const
+	{
+		return 0 == i % 2 ? a.get() : b.get();
+	}
+};
+
+/*
+ * Calls `read`, `process` and `write` on each of the `num_blocks` blocks, in that
+ * order. `read` and `write` are called on the calling thread in block order, while
+ * `process` runs on `pool` (or inline if there is none). Blocks are cycled through
+ * `slots`, so at most `slots.size()` blocks are in flight at any time.
+ */
+template <class Read, class Process, class Write>
+void forEachBlock(ThreadPool* pool, Priority priority, std::vector<BlockSlot>& slots,
+                  size_type num_blocks, Read read, Process process, Write write)
+{
+	if (!pool) {
+		for (size_type i{}; num_blocks > i; ++i) {
+			read(slots[0]);
+			process(slots[0]);
+			write(slots[0]);
+		}
+		return;
+	}
+
+	std::deque<std::future<void>> pending;
+
+	// Blocks still being processed reference `slots`, wait for them if we bail out
+	struct Guard {
+		ThreadPool&                    pool;
+		std::deque<std::future<void>>& pending;
+		~Guard()
+		{
+			for (auto& f : pending) {
+				pool.wait(f);
+			}
+		}
+	} guard{*pool, pending};
+
+	std::size_t next_write{};
+
+	// Taken out of `pending` before `get` may throw, as `~Guard` waits on what is left
+	auto drain = [&]() {
+		auto f = std::move(pending.front());
+		pending.pop_front();
+		pool->wait(f);
+		f.get();
+		write(slots[next_write++ % slots.size()]);
+	};
+
+	for (size_type i{}; num_blocks > i; ++i) {
+		if (slots.size() == pending.size()) {
+			drain();
+		}
+
+		auto& slot = slots[i % slots.size()];
+		read(slot);
+		pending.push_back(pool->submit(priority, [&process, &slot]() { process(slot); }));
+	}
+
+	while (!pending.empty()) {
+		drain();
+	}
+}
+
+/*
+ * Like `forEachBlock`, but `process` is split into `num_stages` calls of
+ * `stage(i, slot)`, each handing the block on to the next stage. A stage runs one block
+ * per task on the shared pool, and queues its next task only if it has another block
+ * waiting, so stage `i` works on block `k` while stage `i + 1` works on block `k - 1`
+ * without the stages holding threads while waiting on each other. Each stage sees the
+ * blocks in order.
+ */
+template <class Read, class Stage, class Write>
+void pipelineBlocks(Priority priority, std::vector<BlockSlot>& slots,
+                    size_type num_blocks, std::size_t num_stages, Read read, Stage stage,
+                    Write write)
+{
+	struct Item {
+		BlockSlot*         slot;
+		std::exception_ptr error;
+		std::promise<void> done;
+	};
+
+	struct Queue {
+		std::deque<Item*> items;
+		std::mutex        mutex;
+		// Whether a task is working through `items`
+		bool running = false;
+	};
+
+	auto&                          pool = ThreadPool::shared();
+	std::vector<Item>              items(slots.size());
+	std::vector<Queue>             queues(num_stages);
+	std::mutex                     tasks_mutex;
+	std::vector<std::future<void>> tasks;
+	std::atomic<bool>              stopped{};
+
+	std::function<void(std::size_t)> schedule;
+
+	// Queues `item` for stage `i`, starting a task for the stage if it has none
+	std::function<void(std::size_t, Item*)> push = [&](std::size_t i, Item* item) {
+		if (num_stages == i) {
+			if (item->error) {
+				item->done.set_exception(item->error);
+			} else {
+				item->done.set_value();
+			}
+			return;
+		}
+
+		{
+			std::scoped_lock lock(queues[i].mutex);
+			queues[i].items.push_back(item);
+			if (std::exchange(queues[i].running, true)) {
+				return;
+			}
+		}
+		schedule(i);
+	};
+
+	// Starts a task running stage `i` on its next block
+	schedule = [&](std::size_t i) {
+		auto task = pool.submit(priority, [&, i]() {
+			Item* item;
+			{
+				std::scoped_lock lock(queues[i].mutex);
+				item = queues[i].items.front();
+				queues[i].items.pop_front();
+			}
+			if (!item->error && !stopped) {
+				try {
+					stage(i, *item->slot);
+				} catch (...) {
+					item->error = std::current_exception();
+				}
+			}
+			push(i + 1, item);
+
+			{
+				std::scoped_lock lock(queues[i].mutex);
+				if (queues[i].items.empty()) {
+					queues[i].running = false;
+					return;
+				}
+			}
+			schedule(i);
+		});
+
+		std::scoped_lock lock(tasks_mutex);
+		tasks.push_back(std::move(task));
+	};
+
+	// Stops the stages and waits for their tasks, also if we bail out. Declared after
+	// `push` and `schedule` so they outlive the tasks calling them
+	struct Guard {
+		ThreadPool&                     pool;
+		std::mutex&                     mutex;
+		std::vector<std::future<void>>& tasks;
+		std::atomic<bool>&              stopped;
+		~Guard()
+		{
+			stopped = true;
+			// A task may start the next stage's task before finishing, which is then
+			// found in the next round
+			while (true) {
+				std::vector<std::future<void>> running;
+				{
+					std::scoped_lock lock(mutex);
+					running.swap(tasks);
+				}
+				if (running.empty()) {
+					return;
+				}
+				for (auto& f : running) {
+					pool.wait(f);
+				}
+			}
+		}
+	} guard{pool, tasks_mutex, tasks, stopped};
+
+	std::vector<Item*> free;
+	for (std::size_t i{}; slots.size() > i; ++i) {
+		items[i].slot = &slots[i];
+		free.push_back(&items[i]);
+	}
+
+	std::deque<std::pair<Item*, std::future<void>>> pending;
+
+	auto drain = [&]() {
+		auto [item, done] = std::move(pending.front());
+		pending.pop_front();
+		pool.wait(done);
+		done.get();
+		write(*item->slot);
+		free.push_back(item);
+	};
+
+	for (size_type i{}; num_blocks > i; ++i) {
+		if (free.empty()) {
+			drain();
+		}
+
+		auto item = free.back();
+		free.pop_back();
+		item->slot->index = i;
+		read(*item->slot);
+		item->error = nullptr;
+		item->done  = {};
+		pending.emplace_back(item, item->done.get_future());
+		push(0, item);
+	}
+
+	while (!pending.empty()) {
+		drain();
+	}
+}
+
+/*
+ * Runs `f(first, last)` over `num_threads` contiguous ranges of `[0, n)` on the shared
+ * pool and waits for all of them, rethrowing the first exception.
+ */
+template <class F>
+void parallelRanges(Priority priority, std::size_t num_threads, size_type n, F f)
+{
+	if (1 >= num_threads) {
+		f(size_type(0), n);
+		return;
+	}
+
+	auto&                          pool = ThreadPool::shared();
+	std::vector<std::future<void>> futures;
+	futures.reserve(num_threads);
+	for (std::size_t t{}; num_threads > t; ++t) {
+		size_type first = n * t / num_threads;
+		size_type last  = n * (t + 1) / num_threads;
+		futures.push_back(pool.submit(priority, [&f, first, last]() { f(first, last); }));
+	}
+
+	for (auto& fut : futures) {
+		pool.wait(fut);
+	}
+	for (auto& fut : futures) {
+		fut.get();
+	}
+}
+
+/*
+ * Runs `f(i)` for each `i` in `[0, n)` on `num_threads` tasks, each taking the next `i`
+ * when done with the previous one, which evens out work of varying size. Waits for all
+ * of them, rethrowing the first exception.
+ */
+template <class F>
+void parallelFor(Priority priority, std::size_t num_threads, size_type n, F f)
+{
+	std::atomic<size_type> next{};
+	auto                   run = [&f, &next, n](size_type, size_type) {
+		for (auto i = next++; n > i; i = next++) {
+			f(i);
+		}
+	};
+	parallelRanges(priority, num_threads, num_threads, run);
+}
+
+// Throws `CompressionCancelled` if the call using `settings` (if any) should stop
+void checkCancelled(Compressor const* settings)
+{
+	if (!settings) {
+		return;
+	}
+	if (settings->cancellation.cancelled()) {
+		throw CompressionCancelled(CompressionCancelled::Reason::CANCELLED);
+	}
+	if (settings->deadline <= std::chrono::steady_clock::now()) {
+		throw CompressionCancelled(CompressionCancelled::Reason::DEADLINE);
+	}
+}
+
+// Compressor `i` of the chain starting at `head`
+[[nodiscard]] Compressor const* nth(Compressor const* head, std::size_t i)
+{
+	for (; 0 < i; --i) {
+		head = &head->next();
+	}
+	return head;
+}
+
+[[nodiscard]] double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+[[nodiscard]] std::byte const* readData(ReadBuffer& in)
+{
+	return reinterpret_cast<std::byte const*>(in.data()) + in.readIndex();
+}
+
+// Makes room for `size` bytes at the write position and returns a pointer to them
+[[nodiscard]] std::byte* writeData(WriteBuffer& out, size_type size)
+{
+	auto pos = out.writeIndex();
+	if (out.size() < pos + size) {
+		out.resize(pos + size);
+	}
+	return reinterpret_cast<std::byte*>(out.data()) + pos;
+}
+
+// Makes room for `size` bytes at the start of `out`, which has no write position
+[[nodiscard]] std::byte* writeData(std::vector<std::byte>& out, size_type size)
+{
+	if (out.size() < size) {
+		out.resize(size);
+	}
+	return out.data();
+}
+
+/*
+ * Moves the write position past the `size` bytes written through `writeData`, and drops
+ * what was made room for but not used. `old_size` is the size before `writeData`.
+ */
+void commitData(WriteBuffer& out, size_type size, size_type old_size)
+{
+	auto pos = out.writeIndex() + size;
+	out.resize(std::max(old_size, pos));
+	out.setWriteIndex(pos);
+}
+
+/*
+ * Writes to `out` at its write position with `f`, which returns the number of bytes it
+ * wrote through `writeData`. Only commits them if `f` succeeds; if it throws, `out` is
+ * shrunk back to its previous size rather than left with the room made for the output.
+ */
+template <class F>
+size_type writeBuffer(WriteBuffer& out, F f)
+{
+	auto old_size = static_cast<size_type>(out.size());
+	try {
+		auto size = f();
+		commitData(out, size, old_size);
+		return size;
+	} catch (...) {
+		out.resize(old_size);
+		throw;
+	}
+}
+
+template <class T>
+void storeValue(std::byte*& dst, T const& value)
+{
+	std::memcpy(dst, &value, sizeof(value));
+	dst += sizeof(value);
+}
+
+// Buffer in front of, between, or after the stages of `pump`
+struct PipeBuffer {
+	ScratchBuffer storage;
+	std::byte*    data{};
+	size_type     cap{};
+	size_type     begin{};
+	size_type     end{};
+
+	void allocate(size_type size)
+	{
+		storage = ScratchBuffer(size);
+		data    = storage.get();
+		cap     = size;
+	}
+
+	void compact()
+	{
+		if (0 < begin) {
+			std::memmove(data, data + begin, end - begin);
+			end -= begin;
+			begin = 0;
+		}
+	}
+};
+
+// Feeds `pump` from a stream, either exactly `size` bytes or until the stages end
+class StreamSource
+{
+ public:
+	StreamSource(std::istream& in, std::optional<size_type> size)
+	    : in_(in), size_(size), left_(size.value_or(0))
+	{
+	}
+
+	void init(PipeBuffer& buf, size_type buffer_size) { buf.allocate(buffer_size); }
+
+	[[nodiscard]] bool eof() const noexcept { return eof_; }
+
+	// Returns whether anything was read
+	bool read(PipeBuffer& buf)
+	{
+		if (eof_) {
+			return false;
+		}
+
+		buf.compact();
+		auto count = buf.cap - buf.end;
+		if (size_) {
+			count = std::min(count, left_);
+		}
+		in_.read(reinterpret_cast<char*>(buf.data + buf.end), count);
+		auto n = static_cast<size_type>(in_.gcount());
+		buf.end += n;
+		if (size_) {
+			if (n != count) {
+				throw std::runtime_error("ufo::Compressor: unexpected end of input");
+			}
+			left_ -= n;
+			eof_ = 0 == left_;
+		} else {
+			eof_ = !in_;
+		}
+		return 0 < n;
+	}
+
+	// Gives back what was read past the end, if possible
+	void finish(PipeBuffer const& buf)
+	{
+		if (!size_ && buf.begin != buf.end) {
+			in_.clear();
+			if (!in_.seekg(-static_cast<std::streamoff>(buf.end - buf.begin), std::ios::cur)) {
+				in_.clear();
+			}
+		}
+	}
+
+ private:
+	std::istream&            in_;
+	std::optional<size_type> size_;
+	size_type                left_;
+	bool                     eof_ = false;
+};
+
+// Feeds `pump` straight from memory, the first stage reads `[data, data + size)`
+class MemorySource
+{
+ public:
+	MemorySource(std::byte const* data, size_type size) : data_(data), size_(size) {}
+
+	void init(PipeBuffer& buf, size_type /* buffer_size */)
+	{
+		// Only ever read from
+		buf.data = const_cast<std::byte*>(data_);
+		buf.cap = buf.end = size_;
+	}
+
+	[[nodiscard]] bool eof() const noexcept { return true; }
+
+	bool read(PipeBuffer& /* buf */) { return false; }
+
+	void finish(PipeBuffer const& buf) { consumed_ = buf.begin; }
+
+	[[nodiscard]] size_type consumed() const noexcept { return consumed_; }
+
+ private:
+	std::byte const* data_;
+	size_type        size_;
+	size_type        consumed_{};
+};
+
+class StreamSink
+{
+ public:
+	explicit StreamSink(std::ostream& out) : out_(out) {}
+
+	void init(PipeBuffer& buf, size_type buffer_size) { buf.allocate(buffer_size); }
+
+	void prepare(PipeBuffer& /* buf */) {}
+
+	void flush(PipeBuffer& buf)
+	{
+		out_.write(reinterpret_cast<char const*>(buf.data + buf.begin), buf.end - buf.begin);
+		written_ += buf.end - buf.begin;
+		buf.begin = buf.end = 0;
+	}
+
+	[[nodiscard]] size_type written(PipeBuffer const& /* buf */) const noexcept
+	{
+		return written_;
+	}
+
+ private:
+	std::ostream& out_;
+	size_type     written_{};
+};
+
+// The last stage writes straight into `out`, which grows as needed
+template <class Buffer>
+class MemorySink
+{
+ public:
+	explicit MemorySink(Buffer& out) : out_(out) {}
+
+	void init(PipeBuffer& /* buf */, size_type buffer_size) { min_free_ = buffer_size; }
+
+	void prepare(PipeBuffer& buf)
+	{
+		if (buf.cap - buf.end < min_free_) {
+			buf.cap  = std::max(2 * buf.cap, buf.end + min_free_);
+			buf.data = writeData(out_, buf.cap);
+		}
+	}
+
+	void flush(PipeBuffer& /* buf */) {}
+
+	[[nodiscard]] size_type written(PipeBuffer const& buf) const noexcept { return buf.end; }
+
+ private:
+	Buffer&   out_;
+	size_type min_free_{};
+};
+
+// Calls `done` with the result of `f`, or with the exception it threw
+template <class F>
+void complete(Compressor::Callback const& done, F f)
+{
+	std::vector<std::byte> result;
+	std::exception_ptr     error;
+	try {
+		result = f();
+	} catch (...) {
+		error = std::current_exception();
+	}
+	done(std::move(result), error);
+}
+
+/*
+ * Writes the file at `path` with `f`, which returns the number of bytes it wrote. The
+ * file is removed if `f` or writing fails, rather than left partly written.
+ */
+template <class F>
+size_type writeFile(std::filesystem::path const& path, F f)
+{
+	std::ofstream file(path, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("ufo::Compressor: cannot create '" + path.string() + "'");
+	}
+
+	try {
+		auto written = f(file);
+		file.close();
+		if (!file) {
+			throw std::runtime_error("ufo::Compressor: cannot write '" + path.string() + "'");
+		}
+		return written;
+	} catch (...) {
+		file.close();
+		std::error_code ec;
+		std::filesystem::remove(path, ec);
+		throw;
+	}
+}
+
+/*
+ * A file mapped into memory, such that (de)compressing reads from and writes to the page
+ * cache directly. Where mapping is not supported, the file is read into memory instead
+ * and written when closed. A file created for writing is removed again unless it is
+ * closed successfully, so a failed call does not leave a partial file behind.
+ */
+class MappedFile
+{
+ public:
+	// Maps the file at `path` for reading
+	explicit MappedFile(std::filesystem::path const& path) : path_(path)
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		struct stat st;
+		fd_ = ::open(path.c_str(), O_RDONLY);
+		if (-1 == fd_ || -1 == ::fstat(fd_, &st)) {
+			fail("cannot open");
+		}
+		map(static_cast<size_type>(st.st_size), PROT_READ, MAP_PRIVATE);
+		if (0 < size_) {
+			::madvise(data_, size_, MADV_SEQUENTIAL);
+		}
+#else
+		std::ifstream in(path, std::ios::binary);
+		size_ = static_cast<size_type>(std::filesystem::file_size(path));
+		buffer_.reset(new std::byte[size_]);
+		data_ = buffer_.get();
+		if (!in.read(reinterpret_cast<char*>(data_), size_)) {
+			fail("cannot read");
+		}
+#endif
+	}
+
+	// Creates the file at `path` with `size` bytes and maps it for writing
+	MappedFile(std::filesystem::path const& path, size_type size) : path_(path)
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (-1 == fd_) {
+			fail("cannot create");
+		}
+		remove_ = true;
+		if (-1 == ::ftruncate(fd_, static_cast<off_t>(size))) {
+			fail("cannot create");
+		}
+		map(size, PROT_READ | PROT_WRITE, MAP_SHARED);
+#else
+		remove_ = true;
+		buffer_.reset(new std::byte[size]);
+		data_ = buffer_.get();
+		size_ = size;
+#endif
+	}
+
+	MappedFile(MappedFile const&) = delete;
+
+	~MappedFile() { discard(); }
+
+	MappedFile& operator=(MappedFile const&) = delete;
+
+	[[nodiscard]] std::byte* data() const noexcept { return data_; }
+
+	[[nodiscard]] size_type size() const noexcept { return size_; }
+
+	// Finishes writing the first `size` bytes, and drops the rest of the file
+	void close(size_type size)
+	{
+#if defined(__unix__) || defined(__APPLE__)
+		if (data_ && 0 != ::munmap(data_, size_)) {
+			fail("cannot write");
+		}
+		data_ = nullptr;
+		if (-1 == ::ftruncate(fd_, static_cast<off_t>(size))) {
+			fail("cannot write");
+		}
+		auto fd = std::exchange(fd_, -1);
+		if (-1 == ::close(fd)) {
+			fail("cannot write");
+		}
+#else
+		std::ofstream out(path_, std::ios::binary);
+		out.write(reinterpret_cast<char const*>(data_), size);
+		out.close();
+		if (!out) {
+			fail("cannot write");
+		}
+#endif
+		remove_ = false;
+	}
+
+ private:
+#if defined(__unix__) || defined(__APPLE__)
+	void map(size_type size, int prot, int flags)
+	{
+		size_ = size;
+		// Empty files cannot be mapped, and have nothing to map
+		if (0 == size) {
+			return;
+		}
+		auto data = ::mmap(nullptr, size, prot, flags, fd_, 0);
+		if (MAP_FAILED == data) {
+			fail("cannot map");
+		}
+		data_ = static_cast<std::byte*>(data);
+	}
+
+	void release() noexcept
+	{
+		if (data_) {
+			::munmap(data_, size_);
+			data_ = nullptr;
+		}
+		if (-1 != fd_) {
+			::close(fd_);
+			fd_ = -1;
+		}
+	}
+
+	[[noreturn]] void fail(char const* what)
+	{
+		auto error = errno;
+		discard();
+		throw std::system_error(error, std::generic_category(),
+		                        std::string("ufo::Compressor: ") + what + " '" +
+		                            path_.string() + "'");
+	}
+#else
+	void release() noexcept {}
+
+	[[noreturn]] void fail(char const* what)
+	{
+		discard();
+		throw std::runtime_error(std::string("ufo::Compressor: ") + what + " '" +
+		                         path_.string() + "'");
+	}
+#endif
+
+	// Releases the file, removing it if it was created and not closed
+	void discard() noexcept
+	{
+		release();
+		if (std::exchange(remove_, false)) {
+			std::error_code ec;
+			std::filesystem::remove(path_, ec);
+		}
+	}
+
+ private:
+	std::filesystem::path path_;
+	std::byte*            data_{};
+	size_type             size_{};
+	bool                  remove_ = false;
+#if defined(__unix__) || defined(__APPLE__)
+	int fd_ = -1;
+#else
+	std::unique_ptr<std::byte[]> buffer_;
+#endif
+};
+
+/*
+ * Pipes the data from `source` through `stages` into `sink`, with a buffer of
+ * `buffer_size` bytes between each two stages, stopping between rounds if `settings`
+ * says so. Returns the number of bytes written.
+ */
+template <class Source, class Sink>
+size_type pump(std::vector<std::unique_ptr<Compressor::Stream>> const& stages,
+               Source& source, Sink& sink, size_type buffer_size,
+               Compressor const& settings)
+{
+	std::vector<PipeBuffer> buffers(stages.size() + 1);
+	for (std::size_t i = 1; stages.size() > i; ++i) {
+		buffers[i].allocate(buffer_size);
+	}
+	source.init(buffers.front(), buffer_size);
+	sink.init(buffers.back(), buffer_size);
+
+	std::vector<bool> done(stages.size());
+	while (!done.back()) {
+		checkCancelled(&settings);
+
+		bool progress = source.read(buffers.front());
+		sink.prepare(buffers.back());
+
+		for (std::size_t i{}; stages.size() > i; ++i) {
+			if (done[i]) {
+				continue;
+			}
+
+			auto& from = buffers[i];
+			auto& to   = buffers[i + 1];
+			to.compact();
+
+			std::byte const* src     = from.data + from.begin;
+			std::byte const* src_end = from.data + from.end;
+			std::byte*       dst     = to.data + to.end;
+			std::byte*       dst_end = to.data + to.cap;
+
+			done[i] = stages[i]->process(src, src_end, dst, dst_end,
+			                             0 == i ? source.eof() : done[i - 1]);
+
+			auto consumed = static_cast<size_type>(src - (from.data + from.begin));
+			auto produced = static_cast<size_type>(dst - (to.data + to.end));
+			from.begin += consumed;
+			to.end += produced;
+			progress |= done[i] || 0 < consumed || 0 < produced;
+		}
+
+		sink.flush(buffers.back());
+
+		if (!progress) {
+			corrupt("unexpected end of compressed data");
+		}
+	}
+
+	source.finish(buffers.front());
+	return sink.written(buffers.back());
+}
+
+struct ArchiveEntry {
+	std::string path;
+	bool        directory{};
+	size_type   offset{};
+	size_type   compressed_size{};
+	size_type   uncompressed_size{};
+};
+
+// A compressed file, handed from the thread compressing it to the one writing it
+struct ArchiveFile {
+	std::unique_ptr<std::byte[]> data;
+	size_type                    size{};
+	size_type                    uncompressed_size{};
+};
+
+/*
+ * The files and directories of the directory `in` sorted by path, such that directories
+ * come before what they hold, or only `in` if it is a regular file.
+ */
+[[nodiscard]] std::vector<ArchiveEntry> archiveEntries(std::filesystem::path const& in)
+{
+	std::vector<ArchiveEntry> entries;
+	if (std::filesystem::is_regular_file(in)) {
+		entries.push_back({in.filename().generic_string()});
+		return entries;
+	} else if (!std::filesystem::is_directory(in)) {
+		throw std::invalid_argument("ufo::Compressor: cannot archive '" + in.string() + "'");
+	}
+
+	for (auto const& entry : std::filesystem::recursive_directory_iterator(in)) {
+		if (entry.is_regular_file() || entry.is_directory()) {
+			entries.push_back({entry.path().lexically_relative(in).generic_string(),
+			                   entry.is_directory()});
+		}
+	}
+	std::sort(entries.begin(), entries.end(),
+	          [](auto const& a, auto const& b) { return a.path < b.path; });
+	return entries;
+}
+
+// Where `path` of an archive is extracted to, which has to be inside of `out`
+[[nodiscard]] std::filesystem::path extractPath(std::filesystem::path const& out,
+                                                std::string const&           path)
+{
+	std::filesystem::path p(path);
+	auto                  parent = std::find(p.begin(), p.end(), "..");
+	if (p.empty() || p.has_root_path() || p.end() != parent) {
+		corrupt("invalid path in archive");
+	}
+	return out / p;
+}
+}  // namespace
+
+/*
+ * Adaptive mode, similar to `zstd --adapt`. Moves every compressor in the chain the same
+ * number of levels up or down (within its own range) whenever the smoothed speed leaves
+ * a band around the target. Each offset gets its own copy of the chain, so blocks
+ * being compressed are not affected by the change.
+ */
+class Compressor::Adapter
+{
+ public:
+	Adapter(Compressor const& compressor, double target_speed, std::size_t parallelism)
+	    : compressor_(compressor), target_(target_speed), parallelism_(parallelism)
+	{
+		for (auto c : compressor.chain()) {
+			min_ = std::min(min_, -c->level());
+			max_ = std::max(max_, c->numLevels() - 1 - c->level());
+		}
+		chains_.resize(max_ - min_ + 1);
+	}
+
+	// The chain to compress the next block with
+	[[nodiscard]] Compressor const& chain()
+	{
+		std::scoped_lock lock(mutex_);
+		if (0 == offset_) {
+			return compressor_;
+		}
+
+		auto& chain = chains_[offset_ - min_];
+		if (!chain) {
+			chain.reset(compressor_.clone());
+			for (auto c : chain->chain()) {
+				c->setLevel(std::clamp(c->level() + offset_, 0, c->numLevels() - 1));
+			}
+		}
+		return *chain;
+	}
+
+	// Tells that a block of `size` bytes took `seconds` to compress
+	void report(size_type size, double seconds)
+	{
+		auto speed = static_cast<double>(size) * parallelism_ / std::max(seconds, 1e-9);
+
+		std::scoped_lock lock(mutex_);
+		speed_ = 0 < speed_ ? 0.7 * speed_ + 0.3 * speed : speed;
+		if (0.9 * target_ > speed_ && min_ < offset_) {
+			--offset_;
+			speed_ = 0;
+		} else if (1.1 * target_ < speed_ && max_ > offset_) {
+			++offset_;
+			speed_ = 0;
+		}
+	}
+
+ private:
+	Compressor const&                        compressor_;
+	double                                   target_;
+	double                                   parallelism_;
+	int                                      min_{};
+	int                                      max_{};
+	int                                      offset_{};
+	double                                   speed_{};
+	std::vector<std::unique_ptr<Compressor>> chains_;
+	std::mutex                               mutex_;
+};
+
+class Compressor::ChunkCompressStream final : public Compressor::Stream
+{
+ public:
+	explicit ChunkCompressStream(Compressor const& compressor)
+	    : compressor_(compressor)
+	    , chunk_size_(std::min<size_type>(CHUNK_SIZE, compressor.maxSizeImpl()))
+	    , in_(chunk_size_)
+	    , out_(CHUNK_HEADER_SIZE + compressor.compressBoundImpl(chunk_size_))
+	{
+	}
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool finish) override
+	{
+		while (true) {
+			auto n = std::min<size_type>(out_end_ - out_begin_, dst_end - dst);
+			std::memcpy(dst, out_.get() + out_begin_, n);
+			dst += n;
+			out_begin_ += n;
+			if (out_begin_ != out_end_) {
+				return false;
+			}
+
+			n = std::min<size_type>(chunk_size_ - in_size_, src_end - src);
+			std::memcpy(in_.get() + in_size_, src, n);
+			src += n;
+			in_size_ += n;
+
+			bool last = finish && src == src_end;
+			if (chunk_size_ != in_size_ && !last) {
+				return false;
+			}
+
+			if (0 == in_size_) {
+				if (ended_) {
+					return true;
+				}
+				std::memset(out_.get(), 0, CHUNK_HEADER_SIZE);
+				out_begin_ = 0;
+				out_end_   = CHUNK_HEADER_SIZE;
+				ended_     = true;
+				continue;
+			}
+
+			auto size = compressor_.compress(in_.get(), out_.get() + CHUNK_HEADER_SIZE,
+			                                 in_size_, compressor_.compressBoundImpl(in_size_));
+			if (0 == size) {
+				throw std::runtime_error("ufo::Compressor: " +
+				                         std::string(enumToString(compressor_.type())) +
+				                         " compression failed");
+			}
+
+			auto compressed_size   = static_cast<std::uint32_t>(size);
+			auto uncompressed_size = static_cast<std::uint32_t>(in_size_);
+			std::memcpy(out_.get(), &compressed_size, sizeof(compressed_size));
+			std::memcpy(out_.get() + sizeof(compressed_size), &uncompressed_size,
+			            sizeof(uncompressed_size));
+
+			out_begin_ = 0;
+			out_end_   = CHUNK_HEADER_SIZE + size;
+			in_size_   = 0;
+		}
+	}
+
+ private:
+	Compressor const& compressor_;
+	size_type         chunk_size_;
+	ScratchBuffer     in_;
+	ScratchBuffer     out_;
+	size_type         in_size_{};
+	size_type         out_begin_{};
+	size_type         out_end_{};
+	bool              ended_ = false;
+};
+
+class Compressor::ChunkDecompressStream final : public Compressor::Stream
+{
+ public:
+	explicit ChunkDecompressStream(Compressor const& compressor)
+	    : compressor_(compressor)
+	    , in_cap_(CHUNK_HEADER_SIZE + compressor.compressBoundImpl(CHUNK_SIZE))
+	    , in_(in_cap_)
+	    , out_(CHUNK_SIZE)
+	{
+	}
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool /* finish */) override
+	{
+		while (true) {
+			auto n = std::min<size_type>(out_end_ - out_begin_, dst_end - dst);
+			std::memcpy(dst, out_.get() + out_begin_, n);
+			dst += n;
+			out_begin_ += n;
+			if (out_begin_ != out_end_) {
+				return false;
+			}
+
+			if (ended_) {
+				return true;
+			}
+
+			take(src, src_end, CHUNK_HEADER_SIZE);
+			if (CHUNK_HEADER_SIZE > in_size_) {
+				return false;
+			}
+
+			std::uint32_t compressed_size;
+			std::uint32_t uncompressed_size;
+			std::memcpy(&compressed_size, in_.get(), sizeof(compressed_size));
+			std::memcpy(&uncompressed_size, in_.get() + sizeof(compressed_size),
+			            sizeof(uncompressed_size));
+			if (in_cap_ - CHUNK_HEADER_SIZE < compressed_size ||
+			    CHUNK_SIZE < uncompressed_size) {
+				corrupt("corrupt chunk header");
+			}
+
+			if (0 == compressed_size && 0 == uncompressed_size) {
+				ended_ = true;
+				return true;
+			}
+
+			take(src, src_end, CHUNK_HEADER_SIZE + compressed_size);
+			if (CHUNK_HEADER_SIZE + compressed_size > in_size_) {
+				return false;
+			}
+
+			auto size = compressor_.decompress(in_.get() + CHUNK_HEADER_SIZE, out_.get(),
+			                                   compressed_size, uncompressed_size);
+			if (uncompressed_size != size) {
+				throw std::runtime_error("ufo::Compressor: " +
+				                         std::string(enumToString(compressor_.type())) +
+				                         " decompression failed");
+			}
+
+			out_begin_ = 0;
+			out_end_   = size;
+			in_size_   = 0;
+		}
+	}
+
+ private:
+	// Moves input into `in_` until it holds `size` bytes
+	void take(std::byte const*& src, std::byte const* src_end, size_type size)
+	{
+		auto n = std::min<size_type>(size - std::min(size, in_size_), src_end - src);
+		std::memcpy(in_.get() + in_size_, src, n);
+		src += n;
+		in_size_ += n;
+	}
+
+ private:
+	Compressor const& compressor_;
+	size_type         in_cap_;
+	ScratchBuffer     in_;
+	ScratchBuffer     out_;
+	size_type         in_size_{};
+	size_type         out_begin_{};
+	size_type         out_end_{};
+	bool              ended_ = false;
+};
+
+std::unique_ptr<Compressor> Compressor::create(CompressionAlgorithm algorithm)
+{
+	switch (algorithm) {
+		case CompressionAlgorithm::NONE: return std::make_unique<CompressorNONE>();
+		case CompressionAlgorithm::LZ4: return std::make_unique<CompressorLZ4>();
+		case CompressionAlgorithm::ZSTD: return std::make_unique<CompressorZSTD>();
+		case CompressionAlgorithm::LZF: return std::make_unique<CompressorLZF>();
+		case CompressionAlgorithm::ZLIB: return std::make_unique<CompressorZLIB>();
+		case CompressionAlgorithm::SHUFFLE: return std::make_unique<CompressorSHUFFLE>();
+		case CompressionAlgorithm::BITSHUFFLE:
+			return std::make_unique<CompressorBITSHUFFLE>();
+		case CompressionAlgorithm::DELTA: return std::make_unique<CompressorDELTA>();
+		case CompressionAlgorithm::XOR: return std::make_unique<CompressorXOR>();
+		case CompressionAlgorithm::QUANTIZE: return std::make_unique<CompressorQUANTIZE>();
+		case CompressionAlgorithm::RLE: return std::make_unique<CompressorRLE>();
+	}
+	throw std::invalid_argument("ufo::Compressor: unknown compression algorithm " +
+	                            std::to_string(static_cast<std::uint32_t>(algorithm)));
+}
+
+std::unique_ptr<Compressor> Compressor::create(
+    std::vector<CompressionAlgorithm> const& chain)
+{
+	if (chain.empty()) {
+		throw std::invalid_argument("ufo::Compressor: empty compressor chain");
+	}
+
+	auto head = create(chain.front());
+	auto tail = head.get();
+	for (auto it = std::next(chain.begin()); chain.end() != it; ++it) {
+		tail->next_ = create(*it);
+		tail        = tail->next_.get();
+	}
+	return head;
+}
+
+std::unique_ptr<Compressor> Compressor::frameChain(
+    std::vector<CompressionAlgorithm> const& types,
+    std::vector<std::vector<std::byte>> const& parameters, Compressor const* settings)
+{
+	auto head = settings && settings->typeChain() == types
+	                ? std::unique_ptr<Compressor>(settings->clone())
+	                : create(types);
+	auto it   = head.get();
+	for (auto const& p : parameters) {
+		it->setParameters(p.data(), p.size());
+		it = it->next_.get();
+	}
+	return head;
+}
+
+Compressor::size_type Compressor::frameHeaderSize() const
+{
+	size_type parameters_size{};
+	for (auto it = this; it; it = it->next_.get()) {
+		parameters_size += it->parameters().size();
+	}
+	return headerSize(size(), parameters_size);
+}
+
+Compressor::size_type Compressor::frameHeader(std::byte* dst, size_type uncompressed_size,
+                                              size_type block_size) const
+{
+	if (MAX_CHAIN_SIZE < size()) {
+		throw std::invalid_argument("ufo::Compressor: chain too long for the format");
+	}
+
+	auto pos = dst;
+	storeValue(pos, FRAME_MAGIC);
+	storeValue(pos, FRAME_VERSION);
+	storeValue(pos, static_cast<std::uint32_t>(size()));
+	for (auto it = this; it; it = it->next_.get()) {
+		auto p = it->parameters();
+		storeValue(pos, static_cast<std::uint32_t>(it->type()));
+		storeValue(pos, static_cast<std::uint32_t>(p.size()));
+		std::copy(p.begin(), p.end(), pos);
+		pos += p.size();
+	}
+	storeValue(pos, static_cast<std::uint64_t>(uncompressed_size));
+	storeValue(pos, static_cast<std::uint64_t>(block_size));
+	return static_cast<size_type>(pos - dst);
+}
+
+void Compressor::setParameters(std::byte const* /* data */, size_type size)
+{
+	if (0 != size) {
+		throw std::runtime_error("ufo::Compressor: unexpected compressor parameters");
+	}
+}
+
+Compressor::size_type Compressor::compressBound(size_type uncompressed_size,
+                                                bool      native) const
+{
+	if (native) {
+		auto bound = compressBoundImpl(uncompressed_size);
+		for (auto it = next_.get(); it; it = it->next_.get()) {
+			bound = it->compressBoundImpl(bound);
+		}
+		return bound;
+	}
+
+	auto bs = blockSize();
+	auto a  = uncompressed_size / bs;
+	auto b  = uncompressed_size % bs;
+
+	size_type bound = frameHeaderSize() +
+	                  indexSize(numBlocks(uncompressed_size, bs)) +
+	                  a * (BLOCK_HEADER_SIZE + compressBound(bs, true));
+	if (0 < b) {
+		bound += BLOCK_HEADER_SIZE + compressBound(b, true);
+	}
+	return bound;
+}
+
+Compressor::size_type Compressor::compress(std::istream& in, std::ostream& out,
+                                           size_type uncompressed_size,
+                                           bool      native) const
+{
+	if (native) {
+		StreamSource source(in, uncompressed_size);
+		StreamSink   sink(out);
+		return pump(compressStages(), source, sink, blockSize(), *this);
+	}
+
+	auto bs         = blockSize();
+	auto bound      = compressBound(bs, true);
+	auto cap        = 1 < size() ? std::max(bs, bound) : 0;
+	auto num_blocks = numBlocks(uncompressed_size, bs);
+	auto threads    = numThreads(num_threads, num_blocks);
+	auto pipelined  = pipeline && 1 < size();
+
+	std::vector<std::byte> header(frameHeaderSize());
+	frameHeader(header.data(), uncompressed_size, bs);
+	out.write(reinterpret_cast<char const*>(header.data()), header.size());
+
+	size_type                  written = header.size();
+	std::vector<std::uint64_t> offsets;
+	offsets.reserve(num_blocks);
+
+	ThreadPool*            pool{};
+	std::vector<BlockSlot> slots;
+	if (pipelined) {
+		for (std::size_t i{}; 2 * size() > i; ++i) {
+			slots.emplace_back(bs, bound, cap);
+		}
+	} else if (1 < threads) {
+		pool = &ThreadPool::shared();
+		// Allow the reading thread to stay ahead of the workers
+		for (std::size_t i{}; 2 * threads > i; ++i) {
+			slots.emplace_back(bs, bound, cap);
+		}
+	} else {
+		slots.emplace_back(bs, bound, cap);
+	}
+
+	size_type left    = uncompressed_size;
+	auto      adapter = this->adapter(uncompressed_size, pipelined ? 1 : threads);
+
+	auto read = [&](BlockSlot& slot) {
+		checkCancelled(this);
+		slot.src_size = std::min(left, bs);
+		left -= slot.src_size;
+		if (!in.read(reinterpret_cast<char*>(slot.src.get()), slot.src_size)) {
+			throw std::runtime_error("ufo::Compressor: unexpected end of input");
+		}
+		slot.in      = slot.src.get();
+		slot.in_size = slot.src_size;
+		slot.chain   = adapter ? &adapter->chain() : this;
+		slot.seconds = 0;
+	};
+
+	auto process = [&adapter, bound, cap](BlockSlot& slot) {
+		auto start    = std::chrono::steady_clock::now();
+		slot.dst_size = slot.chain->compressBlock(slot.src.get(), slot.src_size,
+		                                          slot.dst.get(), bound, slot.a.get(),
+		                                          slot.b.get(), cap);
+		if (adapter) {
+			adapter->report(slot.src_size, secondsSince(start));
+		}
+	};
+
+	auto stage = [this, &adapter, bound, cap](std::size_t i, BlockSlot& slot) {
+		auto start   = std::chrono::steady_clock::now();
+		auto last    = size() == i + 1;
+		auto dst     = last ? slot.dst.get() : slot.scratch(i);
+		slot.in_size = nth(slot.chain, i)->compressChecked(slot.in, slot.in_size, dst,
+		                                                   last ? bound : cap);
+		slot.in      = dst;
+		slot.seconds = std::max(slot.seconds, secondsSince(start));
+		if (last) {
+			slot.dst_size = slot.in_size;
+			if (adapter) {
+				// A pipeline moves at the speed of its slowest stage
+				adapter->report(slot.src_size, slot.seconds);
+			}
+		}
+	};
+
+	auto write = [&](BlockSlot& slot) {
+		offsets.push_back(written);
+		writeValue(out, static_cast<std::uint64_t>(slot.dst_size));
+		writeValue(out, static_cast<std::uint64_t>(slot.src_size));
+		out.write(reinterpret_cast<char const*>(slot.dst.get()), slot.dst_size);
+		written += BLOCK_HEADER_SIZE + slot.dst_size;
+	};
+
+	if (pipelined) {
+		pipelineBlocks(priority, slots, num_blocks, size(), read, stage, write);
+	} else {
+		forEachBlock(pool, priority, slots, num_blocks, read, process, write);
+	}
+
+	out.write(reinterpret_cast<char const*>(offsets.data()),
+	          offsets.size() * sizeof(std::uint64_t));
+	writeValue(out, static_cast<std::uint64_t>(written));
+	writeValue(out, INDEX_MAGIC);
+
+	return written + indexSize(offsets.size());
+}
+
+Compressor::size_type Compressor::decompress(std::istream& in, std::ostream& out,
+                                             bool native) const
+{
+	if (!native) {
+		return decompressFrame(in, out, this);
+	}
+
+	StreamSource source(in, std::nullopt);
+	StreamSink   sink(out);
+	return pump(decompressStages(), source, sink, blockSize(), *this);
+}
+
+Compressor::size_type Compressor::compress(ReadBuffer& in, WriteBuffer& out,
+                                           bool native) const
+{
+	auto src  = readData(in);
+	auto size = static_cast<size_type>(in.readLeft());
+
+	auto written = writeBuffer(out, [&]() {
+		if (native) {
+			MemorySource source(src, size);
+			MemorySink   sink(out);
+			return pump(compressStages(), source, sink, blockSize(), *this);
+		}
+		return compressFrame(src, size, writeData(out, compressBound(size)));
+	});
+
+	in.skipRead(size);
+	return written;
+}
+
+Compressor::size_type Compressor::decompress(ReadBuffer& in, WriteBuffer& out,
+                                             bool native) const
+{
+	if (!native) {
+		return decompressFrame(in, out, this);
+	}
+
+	MemorySource source(readData(in), in.readLeft());
+	auto         written = writeBuffer(out, [&]() {
+		MemorySink sink(out);
+		return pump(decompressStages(), source, sink, blockSize(), *this);
+	});
+
+	in.skipRead(source.consumed());
+	return written;
+}
+
+Compressor::size_type Compressor::decompress(std::istream& in, std::ostream& out)
+{
+	return decompressFrame(in, out, nullptr);
+}
+
+Compressor::size_type Compressor::decompress(ReadBuffer& in, WriteBuffer& out)
+{
+	return decompressFrame(in, out, nullptr);
+}
+
+Compressor::size_type Compressor::compressFile(std::filesystem::path const& in,
+                                               std::filesystem::path const& out,
+                                               bool                         native) const
+{
+	MappedFile src(in);
+	if (native) {
+		return writeFile(out, [&](std::ostream& file) {
+			MemorySource source(src.data(), src.size());
+			StreamSink   sink(file);
+			return pump(compressStages(), source, sink, blockSize(), *this);
+		});
+	}
+
+	MappedFile dst(out, compressBound(src.size()));
+	auto       written = compressFrame(src.data(), src.size(), dst.data());
+	dst.close(written);
+	return written;
+}
+
+Compressor::size_type Compressor::decompressFile(std::filesystem::path const& in,
+                                                 std::filesystem::path const& out,
+                                                 bool native) const
+{
+	MappedFile src(in);
+	if (native) {
+		return writeFile(out, [&](std::ostream& file) {
+			MemorySource source(src.data(), src.size());
+			StreamSink   sink(file);
+			return pump(decompressStages(), source, sink, blockSize(), *this);
+		});
+	}
+
+	auto       size = frameSize(src.data(), src.size());
+	MappedFile dst(out, size);
+	decompressFrame(src.data(), src.size(), dst.data(), this);
+	dst.close(size);
+	return size;
+}
+
+template <class Reader, class Dst>
+Compressor::size_type Compressor::readRange(Reader& in, size_type offset,
+                                            size_type length, Dst dst) const
+{
+	auto header  = readHeader(in);
+	header.chain = frameChain(header.types, header.parameters, this);
+	auto offsets = readIndex(in, header);
+
+	offset = std::min(offset, header.uncompressed_size);
+	length = std::min(length, header.uncompressed_size - offset);
+	if (0 == length) {
+		return 0;
+	}
+
+	auto first = offset / header.block_size;
+	auto last  = (offset + length - 1) / header.block_size + 1;
+	checkIndex(offsets, header, in.size(), first, last);
+
+	// The blocks are back to back, so they are read in one go
+	auto             begin = offsets[first];
+	ScratchBuffer    buffer;
+	std::byte const* data;
+	if constexpr (std::is_same_v<MemoryReader, Reader>) {
+		data = in.data() + begin;
+	} else {
+		buffer = ScratchBuffer(offsets[last] - begin);
+		in.seek(begin);
+		in.read(buffer.get(), offsets[last] - begin);
+		data = buffer.get();
+	}
+
+	auto cap     = header.cap();
+	auto scratch = 1 < header.chain->size() ? cap : 0;
+	auto out     = dst(length);
+
+	// Blocks only partly in the range are decompressed aside and the part copied
+	auto decompress = [&](size_type lo, size_type hi) {
+		ScratchBuffer a(scratch);
+		ScratchBuffer b(scratch);
+		ScratchBuffer part;
+		for (auto i = first + lo; first + hi > i; ++i) {
+			checkCancelled(this);
+			auto size            = header.blockSize(i);
+			auto [src, src_size] = blockData(data + (offsets[i] - begin),
+			                                 offsets[i + 1] - offsets[i], size);
+
+			auto block_offset = i * header.block_size;
+			auto from         = std::max(offset, block_offset);
+			auto to           = std::min(offset + length, block_offset + size);
+			if (block_offset == from && block_offset + size == to) {
+				header.chain->decompressBlock(src, src_size, out + (from - offset), size,
+				                              a.get(), b.get(), cap);
+			} else {
+				part = ScratchBuffer(size);
+				header.chain->decompressBlock(src, src_size, part.get(), size, a.get(),
+				                              b.get(), cap);
+				std::memcpy(out + (from - offset), part.get() + (from - block_offset),
+				            to - from);
+			}
+		}
+	};
+
+	parallelRanges(priority, numThreads(num_threads, last - first), last - first,
+	               decompress);
+	return length;
+}
+
+std::future<std::vector<std::byte>> Compressor::compressAsync(std::vector<std::byte> in,
+                                                             bool native) const
+{
+	std::shared_ptr<Compressor const> self(clone());
+	return ThreadPool::shared().submit(priority, [self, in = std::move(in), native]() {
+		return self->compressVector(in, native);
+	});
+}
+
+void Compressor::compressAsync(std::vector<std::byte> in, Callback done,
+                               bool native) const
+{
+	std::shared_ptr<Compressor const> self(clone());
+	auto& pool = ThreadPool::shared();
+	pool.submit(priority, [self, in = std::move(in), done = std::move(done), native]() {
+		complete(done, [&]() { return self->compressVector(in, native); });
+	});
+}
+
+std::future<std::vector<std::byte>> Compressor::decompressAsync(
+    std::vector<std::byte> in, bool native) const
+{
+	std::shared_ptr<Compressor const> self(clone());
+	return ThreadPool::shared().submit(priority, [self, in = std::move(in), native]() {
+		return self->decompressVector(in, native);
+	});
+}
+
+void Compressor::decompressAsync(std::vector<std::byte> in, Callback done,
+                                 bool native) const
+{
+	std::shared_ptr<Compressor const> self(clone());
+	auto& pool = ThreadPool::shared();
+	pool.submit(priority, [self, in = std::move(in), done = std::move(done), native]() {
+		complete(done, [&]() { return self->decompressVector(in, native); });
+	});
+}
+
+Compressor::size_type Compressor::decompressRange(std::istream& in, std::ostream& out,
+                                                  size_type offset,
+                                                  size_type length) const
+{
+	StreamReader  reader(in);
+	ScratchBuffer buffer;
+	auto          allocate = [&buffer](size_type size) {
+		buffer = ScratchBuffer(size);
+		return buffer.get();
+	};
+
+	auto size = readRange(reader, offset, length, allocate);
+	out.write(reinterpret_cast<char const*>(buffer.get()), size);
+	return size;
+}
+
+Compressor::size_type Compressor::decompressRange(ReadBuffer& in, WriteBuffer& out,
+                                                  size_type offset,
+                                                  size_type length) const
+{
+	MemoryReader reader(readData(in), in.readLeft());
+	return writeBuffer(out, [&]() {
+		return readRange(reader, offset, length,
+		                 [&out](size_type size) { return writeData(out, size); });
+	});
+}
+
+Compressor::size_type Compressor::decompressRange(std::filesystem::path const& in,
+                                                  WriteBuffer& out, size_type offset,
+                                                  size_type length) const
+{
+	MappedFile   file(in);
+	MemoryReader reader(file.data(), file.size());
+	return writeBuffer(out, [&]() {
+		return readRange(reader, offset, length,
+		                 [&out](size_type size) { return writeData(out, size); });
+	});
+}
+
+Compressor::size_type Compressor::compress(std::filesystem::path const& in,
+                                           std::filesystem::path const& out) const
+{
+	auto entries   = archiveEntries(in);
+	auto directory = std::filesystem::is_directory(in);
+
+	std::vector<std::size_t> files;
+	for (std::size_t i{}; entries.size() > i; ++i) {
+		if (!entries[i].directory) {
+			files.push_back(i);
+		}
+	}
+
+	// Files are compressed in parallel instead of their blocks, each by a copy of the
+	// chain on a single thread. A time budget is for the whole call, not for each file.
+	std::unique_ptr<Compressor> settings(clone());
+	settings->num_threads = 1;
+	settings->pipeline    = false;
+	settings->time_budget = {};
+
+	auto compressEntry = [&settings](std::filesystem::path const& path) {
+		MappedFile  src(path);
+		ArchiveFile compressed;
+		compressed.uncompressed_size = src.size();
+		compressed.data.reset(new std::byte[settings->compressBound(src.size())]);
+		compressed.size =
+		    settings->compressFrame(src.data(), src.size(), compressed.data.get());
+		return compressed;
+	};
+
+	// A failed archive is removed rather than left truncated
+	return writeFile(out, [&](std::ostream& file) {
+		writeValue(file, ARCHIVE_MAGIC);
+		writeValue(file, ARCHIVE_VERSION);
+		size_type written = ARCHIVE_HEADER_SIZE;
+
+		auto threads = numThreads(num_threads, files.size());
+		auto pool    = 1 < threads ? &ThreadPool::shared() : nullptr;
+
+		// Allow the workers to stay ahead of the writing thread
+		std::deque<std::pair<std::size_t, std::future<ArchiveFile>>> pending;
+
+		// Files still being compressed use `settings`, wait for them if we bail out
+		struct Guard {
+			ThreadPool*                                                    pool;
+			std::deque<std::pair<std::size_t, std::future<ArchiveFile>>>& pending;
+			~Guard()
+			{
+				for (auto& [i, f] : pending) {
+					if (pool) {
+						pool->wait(f);
+					}
+				}
+			}
+		} guard{pool, pending};
+
+		auto write = [&]() {
+			// Taken out of `pending` before `get` may throw, as `~Guard` waits on the
+			// rest
+			auto [i, future] = std::move(pending.front());
+			pending.pop_front();
+			if (pool) {
+				pool->wait(future);
+			}
+			auto compressed = future.get();
+			entries[i].offset            = written;
+			entries[i].compressed_size   = compressed.size;
+			entries[i].uncompressed_size = compressed.uncompressed_size;
+
+			file.write(reinterpret_cast<char const*>(compressed.data.get()), compressed.size);
+			written += compressed.size;
+		};
+
+		for (auto i : files) {
+			if (2 * threads == pending.size()) {
+				write();
+			}
+
+			auto path = directory ? in / entries[i].path : in;
+			auto compress = [&compressEntry, path]() { return compressEntry(path); };
+			pending.emplace_back(i, pool ? pool->submit(priority, compress)
+			                             : std::async(std::launch::deferred, compress));
+		}
+
+		while (!pending.empty()) {
+			write();
+		}
+
+		auto index = written;
+		writeValue(file, static_cast<std::uint64_t>(entries.size()));
+		written += sizeof(std::uint64_t);
+		for (auto const& entry : entries) {
+			writeValue(file, static_cast<std::uint32_t>(entry.directory ? 1 : 0));
+			writeValue(file, static_cast<std::uint32_t>(entry.path.size()));
+			file.write(entry.path.data(), entry.path.size());
+			writeValue(file, static_cast<std::uint64_t>(entry.offset));
+			writeValue(file, static_cast<std::uint64_t>(entry.compressed_size));
+			writeValue(file, static_cast<std::uint64_t>(entry.uncompressed_size));
+			written += ARCHIVE_ENTRY_SIZE + entry.path.size();
+		}
+		writeValue(file, static_cast<std::uint64_t>(index));
+		writeValue(file, ARCHIVE_INDEX_MAGIC);
+		written += INDEX_TRAILER_SIZE;
+
+		return written;
+	});
+}
+
+Compressor::size_type Compressor::decompress(std::filesystem::path const& in,
+                                             std::filesystem::path const& out) const
+{
+	MappedFile   file(in);
+	MemoryReader reader(file.data(), file.size());
+	if (ARCHIVE_MAGIC != readValue<std::uint32_t>(reader)) {
+		corrupt("not an archive");
+	} else if (ARCHIVE_VERSION != readValue<std::uint32_t>(reader)) {
+		corrupt("unsupported archive version");
+	}
+
+	auto size = file.size();
+	if (ARCHIVE_HEADER_SIZE + sizeof(std::uint64_t) + INDEX_TRAILER_SIZE > size) {
+		corrupt("corrupt archive index");
+	}
+	reader.seek(size - INDEX_TRAILER_SIZE);
+	auto index = static_cast<size_type>(readValue<std::uint64_t>(reader));
+	if (ARCHIVE_INDEX_MAGIC != readValue<std::uint32_t>(reader) ||
+	    ARCHIVE_HEADER_SIZE > index ||
+	    size - INDEX_TRAILER_SIZE - sizeof(std::uint64_t) < index) {
+		corrupt("corrupt archive index");
+	}
+
+	reader.seek(index);
+	auto num  = static_cast<size_type>(readValue<std::uint64_t>(reader));
+	auto left = size - INDEX_TRAILER_SIZE - sizeof(std::uint64_t) - index;
+	if (left / ARCHIVE_ENTRY_SIZE < num) {
+		corrupt("corrupt archive index");
+	}
+
+	std::vector<ArchiveEntry> entries(num);
+	for (auto& entry : entries) {
+		auto type      = readValue<std::uint32_t>(reader);
+		auto path_size = readValue<std::uint32_t>(reader);
+		if (1 < type || left < ARCHIVE_ENTRY_SIZE + path_size) {
+			corrupt("corrupt archive index");
+		}
+		left -= ARCHIVE_ENTRY_SIZE + path_size;
+
+		entry.directory = 1 == type;
+		entry.path.resize(path_size);
+		reader.read(entry.path.data(), path_size);
+		entry.offset            = static_cast<size_type>(readValue<std::uint64_t>(reader));
+		entry.compressed_size   = static_cast<size_type>(readValue<std::uint64_t>(reader));
+		entry.uncompressed_size = static_cast<size_type>(readValue<std::uint64_t>(reader));
+		if (!entry.directory && (ARCHIVE_HEADER_SIZE > entry.offset || index < entry.offset ||
+		                         index - entry.offset < entry.compressed_size)) {
+			corrupt("corrupt archive index");
+		}
+	}
+
+	std::filesystem::create_directories(out);
+	std::vector<ArchiveEntry const*> files;
+	size_type                        total{};
+	for (auto const& entry : entries) {
+		auto path = extractPath(out, entry.path);
+		std::filesystem::create_directories(entry.directory ? path : path.parent_path());
+		if (!entry.directory) {
+			files.push_back(&entry);
+			total += entry.uncompressed_size;
+		}
+	}
+
+	std::unique_ptr<Compressor> settings(clone());
+	settings->num_threads = 1;
+	settings->pipeline    = false;
+
+	// Straight from the mapped archive into the mapped file
+	auto extract = [&file, &out, &settings](ArchiveEntry const& entry) {
+		auto src = file.data() + entry.offset;
+		if (entry.uncompressed_size != frameSize(src, entry.compressed_size)) {
+			corrupt("corrupt archive entry");
+		}
+
+		MappedFile dst(extractPath(out, entry.path), entry.uncompressed_size);
+		if (entry.compressed_size !=
+		    decompressFrame(src, entry.compressed_size, dst.data(), settings.get())) {
+			corrupt("corrupt archive entry");
+		}
+		dst.close(entry.uncompressed_size);
+	};
+
+	parallelFor(priority, numThreads(num_threads, files.size()), files.size(),
+	            [&extract, &files](size_type i) { extract(*files[i]); });
+	return total;
+}
+
+Compressor::size_type Compressor::decompressFrame(std::istream& in, std::ostream& out,
+                                                  Compressor const* settings)
+{
+	StreamReader reader(in);
+	auto         header = readHeader(reader);
+	if (reader.seekable()) {
+		checkHeader(header, reader.size());
+	}
+	header.chain = frameChain(header.types, header.parameters, settings);
+
+	auto cap       = header.cap();
+	auto scratch   = 1 < header.chain->size() ? cap : 0;
+	auto threads   = numThreads(settings ? settings->num_threads : 1, header.num_blocks);
+	auto pipelined = settings && settings->pipeline && 1 < header.chain->size();
+	auto priority  = settings ? settings->priority : Priority::NORMAL;
+
+	ThreadPool*            pool{};
+	std::vector<BlockSlot> slots;
+	if (pipelined) {
+		for (std::size_t i{}; 2 * header.chain->size() > i; ++i) {
+			slots.emplace_back(cap, header.maxBlockSize(), scratch);
+		}
+	} else if (1 < threads) {
+		pool = &ThreadPool::shared();
+		for (std::size_t i{}; 2 * threads > i; ++i) {
+			slots.emplace_back(cap, header.maxBlockSize(), scratch);
+		}
+	} else {
+		slots.emplace_back(cap, header.maxBlockSize(), scratch);
+	}
+
+	// Not reserved from the header, which is only checked as the blocks are read
+	std::vector<std::uint64_t> offsets;
+	size_type                  pos = header.size;
+
+	auto read = [&](BlockSlot& slot) {
+		checkCancelled(settings);
+		slot.src_size = static_cast<size_type>(readValue<std::uint64_t>(reader));
+		slot.dst_size = static_cast<size_type>(readValue<std::uint64_t>(reader));
+		if (cap < slot.src_size || header.blockSize(offsets.size()) != slot.dst_size) {
+			corrupt("corrupt block header");
+		}
+		reader.read(slot.src.get(), slot.src_size);
+		slot.in      = slot.src.get();
+		slot.in_size = slot.src_size;
+
+		offsets.push_back(pos);
+		pos += BLOCK_HEADER_SIZE + slot.src_size;
+	};
+
+	auto process = [&header, cap](BlockSlot& slot) {
+		header.chain->decompressBlock(slot.src.get(), slot.src_size, slot.dst.get(),
+		                              slot.dst_size, slot.a.get(), slot.b.get(), cap);
+	};
+
+	auto chain = header.chain->chain();
+	auto stage = [&chain, cap](std::size_t i, BlockSlot& slot) {
+		auto last    = chain.size() == i + 1;
+		auto dst     = last ? slot.dst.get() : slot.scratch(i);
+		slot.in_size = chain[chain.size() - 1 - i]->decompressChecked(
+		    slot.in, slot.in_size, dst, last ? slot.dst_size : cap);
+		slot.in = dst;
+		if (last && slot.dst_size != slot.in_size) {
+			corrupt("decompressed size mismatch");
+		}
+	};
+
+	auto write = [&out](BlockSlot& slot) {
+		out.write(reinterpret_cast<char const*>(slot.dst.get()), slot.dst_size);
+	};
+
+	if (pipelined) {
+		pipelineBlocks(priority, slots, header.num_blocks, chain.size(), read, stage,
+		               write);
+	} else {
+		forEachBlock(pool, priority, slots, header.num_blocks, read, process, write);
+	}
+
+	std::vector<std::uint64_t> index(header.num_blocks);
+	reader.read(index.data(), index.size() * sizeof(std::uint64_t));
+	if (index != offsets || pos != readValue<std::uint64_t>(reader) ||
+	    INDEX_MAGIC != readValue<std::uint32_t>(reader)) {
+		corrupt("corrupt block index");
+	}
+
+	return header.uncompressed_size;
+}
+
+Compressor::size_type Compressor::decompressFrame(ReadBuffer& in, WriteBuffer& out,
+                                                  Compressor const* settings)
+{
+	auto      src  = readData(in);
+	auto      size = frameSize(src, in.readLeft());
+	size_type read{};
+	writeBuffer(out, [&]() {
+		read = decompressFrame(src, in.readLeft(), writeData(out, size), settings);
+		return size;
+	});
+	in.skipRead(read);
+	return size;
+}
+
+Compressor::size_type Compressor::decompressFrame(std::byte const* src,
+                                                  size_type src_size, std::byte* dst,
+                                                  Compressor const* settings)
+{
+	MemoryReader reader(src, src_size);
+	auto         header = readHeader(reader);
+	header.chain        = frameChain(header.types, header.parameters, settings);
+
+	auto offsets     = readIndex(reader, header);
+	auto cap         = header.cap();
+	auto scratch     = 1 < header.chain->size() ? cap : 0;
+	auto num_threads = settings ? settings->num_threads : 1;
+	auto priority    = settings ? settings->priority : Priority::NORMAL;
+
+	// Returns the compressed data of block `i` and its size
+	auto block = [&](size_type i) {
+		return blockData(src + offsets[i], offsets[i + 1] - offsets[i], header.blockSize(i));
+	};
+
+	// Each block knows where it goes, so the threads write straight into `dst`
+	auto decompress = [&](size_type first, size_type last) {
+		ScratchBuffer a(scratch);
+		ScratchBuffer b(scratch);
+		for (auto i = first; last > i; ++i) {
+			checkCancelled(settings);
+			auto [src, src_size] = block(i);
+			header.chain->decompressBlock(src, src_size, dst + i * header.block_size,
+			                              header.blockSize(i), a.get(), b.get(), cap);
+		}
+	};
+
+	checkIndex(offsets, header, src_size, 0, header.num_blocks);
+
+	if (settings && settings->pipeline && 1 < header.chain->size()) {
+		auto chain = header.chain->chain();
+
+		auto read = [&](BlockSlot& slot) {
+			checkCancelled(settings);
+			std::tie(slot.in, slot.in_size) = block(slot.index);
+		};
+
+		auto stage = [&](std::size_t i, BlockSlot& slot) {
+			auto last    = chain.size() == i + 1;
+			auto size    = header.blockSize(slot.index);
+			auto to      = last ? dst + slot.index * header.block_size : slot.scratch(i);
+			slot.in_size = chain[chain.size() - 1 - i]->decompressChecked(
+			    slot.in, slot.in_size, to, last ? size : cap);
+			slot.in = to;
+			if (last && size != slot.in_size) {
+				corrupt("decompressed size mismatch");
+			}
+		};
+
+		std::vector<BlockSlot> slots;
+		for (std::size_t i{}; 2 * chain.size() > i; ++i) {
+			slots.emplace_back(0, 0, cap);
+		}
+		pipelineBlocks(priority, slots, header.num_blocks, chain.size(), read, stage,
+		               [](BlockSlot&) {});
+	} else {
+		parallelRanges(priority, numThreads(num_threads, header.num_blocks),
+		               header.num_blocks, decompress);
+	}
+
+	return offsets.back() + indexSize(header.num_blocks);
+}
+
+std::unique_ptr<Compressor::Stream> Compressor::compressStream() const
+{
+	return std::make_unique<ChunkCompressStream>(*this);
+}
+
+std::unique_ptr<Compressor::Stream> Compressor::decompressStream() const
+{
+	return std::make_unique<ChunkDecompressStream>(*this);
+}
+
+Compressor::size_type Compressor::blockSize() const
+{
+	return std::clamp(block_size, size_type(1),
+	                  std::min(maxSize(true), static_cast<size_type>(MAX_BLOCK_SIZE)));
+}
+
+std::size_t Compressor::numThreads(std::size_t num_threads, size_type num_blocks)
+{
+	size_type threads = 0 == num_threads ? ThreadPool::shared().size() : num_threads;
+	return static_cast<std::size_t>(
+	    std::clamp(num_blocks, size_type(1), std::max(threads, size_type(1))));
+}
+
+std::unique_ptr<Compressor::Adapter> Compressor::adapter(size_type   uncompressed_size,
+                                                        std::size_t parallelism) const
+{
+	auto speed = target_speed;
+	if (0 < time_budget.count()) {
+		speed = std::max(speed, static_cast<double>(uncompressed_size) / time_budget.count());
+	}
+	return 0 < speed ? std::make_unique<Adapter>(*this, speed, parallelism) : nullptr;
+}
+
+std::vector<std::unique_ptr<Compressor::Stream>> Compressor::compressStages() const
+{
+	std::vector<std::unique_ptr<Stream>> stages;
+	for (auto it = this; it; it = it->next_.get()) {
+		stages.push_back(it->compressStream());
+	}
+	return stages;
+}
+
+std::vector<std::unique_ptr<Compressor::Stream>> Compressor::decompressStages() const
+{
+	auto                                 chain = this->chain();
+	std::vector<std::unique_ptr<Stream>> stages;
+	for (auto it = chain.rbegin(); chain.rend() != it; ++it) {
+		stages.push_back((*it)->decompressStream());
+	}
+	return stages;
+}
+
+Compressor::size_type Compressor::compressFrame(std::byte const* src,
+                                                size_type        uncompressed_size,
+                                                std::byte*       dst) const
+{
+	auto bs         = blockSize();
+	auto bound      = compressBound(bs, true);
+	auto cap        = 1 < size() ? std::max(bs, bound) : 0;
+	auto num_blocks = numBlocks(uncompressed_size, bs);
+
+	/*
+	 * Each range of blocks is written back to back starting where its first block would
+	 * be if all blocks before it were of maximum size, so the ranges cannot overlap.
+	 * The ranges are then moved down to close the gaps, which a single range never has.
+	 * Until then the offset of each block is kept where the index would be if all blocks
+	 * were of maximum size, which no block reaches, and its size in its block header.
+	 */
+	auto header_size = frameHeader(dst, uncompressed_size, bs);
+	auto stride      = BLOCK_HEADER_SIZE + bound;
+	auto offsets     = dst + compressBound(uncompressed_size) - indexSize(num_blocks);
+
+	auto setOffset = [offsets](size_type i, size_type offset) {
+		auto pos = offsets + i * sizeof(std::uint64_t);
+		storeValue(pos, static_cast<std::uint64_t>(offset));
+	};
+	auto getOffset = [offsets](size_type i) {
+		std::uint64_t offset;
+		std::memcpy(&offset, offsets + i * sizeof(std::uint64_t), sizeof(offset));
+		return static_cast<size_type>(offset);
+	};
+
+	auto pipelined = pipeline && 1 < size();
+	auto threads   = numThreads(num_threads, num_blocks);
+	auto adapter   = this->adapter(uncompressed_size, pipelined ? 1 : threads);
+
+	auto compress = [&](size_type first, size_type last) {
+		ScratchBuffer a(cap);
+		ScratchBuffer b(cap);
+		auto          off = header_size + first * stride;
+		for (auto i = first; last > i; ++i) {
+			checkCancelled(this);
+			auto start = std::chrono::steady_clock::now();
+			auto chain = adapter ? &adapter->chain() : this;
+			auto n     = std::min(bs, uncompressed_size - i * bs);
+			auto cs    = chain->compressBlock(src + i * bs, n, dst + off + BLOCK_HEADER_SIZE,
+			                                  compressBound(n, true), a.get(), b.get(), cap);
+			if (adapter) {
+				adapter->report(n, secondsSince(start));
+			}
+
+			auto block = dst + off;
+			storeValue(block, static_cast<std::uint64_t>(cs));
+			storeValue(block, static_cast<std::uint64_t>(n));
+
+			setOffset(i, off);
+			off += BLOCK_HEADER_SIZE + cs;
+		}
+	};
+
+	if (pipelined) {
+		// The last stage sees the blocks in order, so it writes them without gaps
+		size_type off = header_size;
+
+		auto read = [&](BlockSlot& slot) {
+			checkCancelled(this);
+			slot.src_size = std::min(bs, uncompressed_size - slot.index * bs);
+			slot.in       = src + slot.index * bs;
+			slot.in_size  = slot.src_size;
+			slot.chain    = adapter ? &adapter->chain() : this;
+			slot.seconds  = 0;
+		};
+
+		auto stage = [&](std::size_t i, BlockSlot& slot) {
+			auto start = std::chrono::steady_clock::now();
+			if (size() != i + 1) {
+				slot.in_size = nth(slot.chain, i)->compressChecked(slot.in, slot.in_size,
+				                                                   slot.scratch(i), cap);
+				slot.in      = slot.scratch(i);
+				slot.seconds = std::max(slot.seconds, secondsSince(start));
+				return;
+			}
+
+			auto cs = nth(slot.chain, i)->compressChecked(
+			    slot.in, slot.in_size, dst + off + BLOCK_HEADER_SIZE,
+			    compressBound(slot.src_size, true));
+			if (adapter) {
+				adapter->report(slot.src_size,
+				                std::max(slot.seconds, secondsSince(start)));
+			}
+
+			auto block = dst + off;
+			storeValue(block, static_cast<std::uint64_t>(cs));
+			storeValue(block, static_cast<std::uint64_t>(slot.src_size));
+
+			setOffset(slot.index, off);
+			off += BLOCK_HEADER_SIZE + cs;
+		};
+
+		std::vector<BlockSlot> slots;
+		for (std::size_t i{}; 2 * size() > i; ++i) {
+			slots.emplace_back(0, 0, cap);
+		}
+		pipelineBlocks(priority, slots, num_blocks, size(), read, stage, [](BlockSlot&) {});
+	} else {
+		parallelRanges(priority, threads, num_blocks, compress);
+	}
+
+	size_type written = header_size;
+	for (size_type i{}; num_blocks > i; ++i) {
+		auto          offset = getOffset(i);
+		std::uint64_t cs;
+		std::memcpy(&cs, dst + offset, sizeof(cs));
+		auto bytes = BLOCK_HEADER_SIZE + static_cast<size_type>(cs);
+		if (offset != written) {
+			std::memmove(dst + written, dst + offset, bytes);
+			setOffset(i, written);
+		}
+		written += bytes;
+	}
+
+	auto pos = dst + written;
+	std::memmove(pos, offsets, num_blocks * sizeof(std::uint64_t));
+	pos += num_blocks * sizeof(std::uint64_t);
+	storeValue(pos, static_cast<std::uint64_t>(written));
+	storeValue(pos, INDEX_MAGIC);
+
+	return written + indexSize(num_blocks);
+}
+
+std::vector<std::byte> Compressor::compressVector(std::vector<std::byte> const& in,
+                                                  bool native) const
+{
+	std::vector<std::byte> out;
+	if (native) {
+		MemorySource source(in.data(), in.size());
+		MemorySink   sink(out);
+		out.resize(pump(compressStages(), source, sink, blockSize(), *this));
+	} else {
+		out.resize(compressBound(in.size()));
+		out.resize(compressFrame(in.data(), in.size(), out.data()));
+	}
+	return out;
+}
+
+std::vector<std::byte> Compressor::decompressVector(std::vector<std::byte> const& in,
+                                                    bool native) const
+{
+	std::vector<std::byte> out;
+	if (native) {
+		MemorySource source(in.data(), in.size());
+		MemorySink   sink(out);
+		out.resize(pump(decompressStages(), source, sink, blockSize(), *this));
+	} else {
+		out.resize(frameSize(in.data(), in.size()));
+		decompressFrame(in.data(), in.size(), out.data(), this);
+	}
+	return out;
+}
+
+Compressor::size_type Compressor::compressChecked(std::byte const* src,
+                                                  size_type src_size, std::byte* dst,
+                                                  size_type dst_cap) const
+{
+	auto size = compress(src, dst, src_size, dst_cap);
+	if (0 == size && 0 < src_size) {
+		throw std::runtime_error("ufo::Compressor: " + std::string(enumToString(type())) +
+		                         " compression failed");
+	}
+	return size;
+}
+
+Compressor::size_type Compressor::decompressChecked(std::byte const* src,
+                                                    size_type src_size, std::byte* dst,
+                                                    size_type dst_cap) const
+{
+	auto size = decompress(src, dst, src_size, dst_cap);
+	if (0 == size && 0 < src_size) {
+		throw std::runtime_error("ufo::Compressor: " + std::string(enumToString(type())) +
+		                         " decompression failed");
+	}
+	return size;
+}
+
+Compressor::size_type Compressor::compressBlock(std::byte const* src, size_type src_size,
+                                                std::byte* dst, size_type dst_cap,
+                                                std::byte* a, std::byte* b,
+                                                size_type cap) const
+{
+	std::byte const* in = src;
+	for (auto it = this; it; it = it->next_.get()) {
+		auto last = !it->next_;
+		auto out  = last ? dst : a;
+		src_size  = it->compressChecked(in, src_size, out, last ? dst_cap : cap);
+		in        = out;
+		std::swap(a, b);
+	}
+	return src_size;
+}
+
+void Compressor::decompressBlock(std::byte const* src, size_type src_size, std::byte* dst,
+                                 size_type uncompressed_size, std::byte* a, std::byte* b,
+                                 size_type cap) const
+{
+	// Walked back to front without allocating, chains of frames are at most this long
+	std::array<Compressor const*, MAX_CHAIN_SIZE> chain;
+	std::size_t                                   n{};
+	for (auto it = this; it; it = it->next_.get()) {
+		if (chain.size() == n) {
+			corrupt("invalid compressor chain");
+		}
+		chain[n++] = it;
+	}
+
+	std::byte const* in = src;
+	while (0 < n) {
+		auto last = 1 == n;
+		auto out  = last ? dst : a;
+		src_size  = chain[--n]->decompressChecked(in, src_size, out,
+		                                          last ? uncompressed_size : cap);
+		in        = out;
+		std::swap(a, b);
+	}
+
+	if (uncompressed_size != src_size) {
+		corrupt("decompressed size mismatch");
+	}
+}
+}  // namespace ufo
\ No newline at end of file
@@ -0,0 +1,348 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//  UFO
+#include "element_size.hpp"
+#include <ufo/compression/delta.hpp>
+
+// STL
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// SIMD
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ufo
+{
+namespace
+{
+using size_type = Compressor::size_type;
+
+#if defined(__SSE2__)
+template <class T>
+__m128i add(__m128i a, __m128i b)
+{
+	if constexpr (1 == sizeof(T)) {
+		return _mm_add_epi8(a, b);
+	} else if constexpr (2 == sizeof(T)) {
+		return _mm_add_epi16(a, b);
+	} else if constexpr (4 == sizeof(T)) {
+		return _mm_add_epi32(a, b);
+	} else {
+		return _mm_add_epi64(a, b);
+	}
+}
+
+template <class T>
+__m128i sub(__m128i a, __m128i b)
+{
+	if constexpr (1 == sizeof(T)) {
+		return _mm_sub_epi8(a, b);
+	} else if constexpr (2 == sizeof(T)) {
+		return _mm_sub_epi16(a, b);
+	} else if constexpr (4 == sizeof(T)) {
+		return _mm_sub_epi32(a, b);
+	} else {
+		return _mm_sub_epi64(a, b);
+	}
+}
+
+template <class T>
+__m128i broadcast(T value)
+{
+	if constexpr (1 == sizeof(T)) {
+		return _mm_set1_epi8(static_cast<char>(value));
+	} else if constexpr (2 == sizeof(T)) {
+		return _mm_set1_epi16(static_cast<short>(value));
+	} else if constexpr (4 == sizeof(T)) {
+		return _mm_set1_epi32(static_cast<int>(value));
+	} else {
+		return _mm_set1_epi64x(static_cast<long long>(value));
+	}
+}
+#endif
+
+struct Delta {
+	template <class T>
+	static T forward(T value, T prev)
+	{
+		return static_cast<T>(value - prev);
+	}
+
+	template <class T>
+	static T inverse(T value, T prev)
+	{
+		return static_cast<T>(value + prev);
+	}
+
+#if defined(__SSE2__)
+	template <class T>
+	static __m128i forward(__m128i value, __m128i prev)
+	{
+		return sub<T>(value, prev);
+	}
+
+	template <class T>
+	static __m128i inverse(__m128i value, __m128i prev)
+	{
+		return add<T>(value, prev);
+	}
+#endif
+};
+
+struct Xor {
+	template <class T>
+	static T forward(T value, T prev)
+	{
+		return static_cast<T>(value ^ prev);
+	}
+
+	template <class T>
+	static T inverse(T value, T prev)
+	{
+		return static_cast<T>(value ^ prev);
+	}
+
+#if defined(__SSE2__)
+	template <class T>
+	static __m128i forward(__m128i value, __m128i prev)
+	{
+		return _mm_xor_si128(value, prev);
+	}
+
+	template <class T>
+	static __m128i inverse(__m128i value, __m128i prev)
+	{
+		return _mm_xor_si128(value, prev);
+	}
+#endif
+};
+
+template <class T>
+T load(std::byte const* src, size_type i)
+{
+	T value;
+	std::memcpy(&value, src + i * sizeof(T), sizeof(T));
+	return value;
+}
+
+template <class T>
+void store(std::byte* dst, size_type i, T value)
+{
+	std::memcpy(dst + i * sizeof(T), &value, sizeof(T));
+}
+
+// Each element combined with the previous one, which the SIMD loop loads one element
+// behind the current ones
+template <class Op, class T>
+void forward(std::byte const* src, std::byte* dst, size_type num)
+{
+	size_type i{};
+#if defined(__SSE2__)
+	constexpr size_type LANES = 16 / sizeof(T);
+	if (LANES < num) {
+		store(dst, 0, load<T>(src, 0));
+		for (i = 1; num >= i + LANES; i += LANES) {
+			auto value = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * sizeof(T)));
+			auto prev =
+			    _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + (i - 1) * sizeof(T)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * sizeof(T)),
+			                 Op::template forward<T>(value, prev));
+		}
+	}
+#endif
+	for (; num > i; ++i) {
+		store(dst, i, Op::forward(load<T>(src, i), 0 == i ? T{} : load<T>(src, i - 1)));
+	}
+}
+
+/*
+ * A prefix sum (or XOR). The SIMD loop does it within a vector in log2(lanes) shifted
+ * steps and then adds the last element of the previous vector.
+ */
+template <class Op, class T>
+void inverse(std::byte const* src, std::byte* dst, size_type num)
+{
+	T         prev{};
+	size_type i{};
+#if defined(__SSE2__)
+	constexpr size_type LANES = 16 / sizeof(T);
+	for (; num >= i + LANES; i += LANES) {
+		auto x = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * sizeof(T)));
+		if constexpr (1 == sizeof(T)) {
+			x = Op::template inverse<T>(x, _mm_slli_si128(x, 1));
+		}
+		if constexpr (2 >= sizeof(T)) {
+			x = Op::template inverse<T>(x, _mm_slli_si128(x, 2));
+		}
+		if constexpr (4 >= sizeof(T)) {
+			x = Op::template inverse<T>(x, _mm_slli_si128(x, 4));
+		}
+		x = Op::template inverse<T>(x, _mm_slli_si128(x, 8));
+		x = Op::template inverse<T>(x, broadcast(prev));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * sizeof(T)), x);
+		prev = load<T>(dst, i + LANES - 1);
+	}
+#endif
+	for (; num > i; ++i) {
+		prev = Op::inverse(load<T>(src, i), prev);
+		store(dst, i, prev);
+	}
+}
+
+template <class Op, bool Forward, class T>
+void apply(std::byte const* src, std::byte* dst, size_type num)
+{
+	if constexpr (Forward) {
+		forward<Op, T>(src, dst, num);
+	} else {
+		inverse<Op, T>(src, dst, num);
+	}
+}
+
+// Returns false if there is no integer type of `element_size` bytes
+template <class Op, bool Forward>
+bool filter(std::byte const* src, std::byte* dst, size_type size,
+            std::size_t element_size)
+{
+	auto num = size / element_size;
+	switch (element_size) {
+		case 1: apply<Op, Forward, std::uint8_t>(src, dst, num); break;
+		case 2: apply<Op, Forward, std::uint16_t>(src, dst, num); break;
+		case 4: apply<Op, Forward, std::uint32_t>(src, dst, num); break;
+		case 8: apply<Op, Forward, std::uint64_t>(src, dst, num); break;
+		default: return false;
+	}
+	std::memcpy(dst + num * element_size, src + num * element_size,
+	            size - num * element_size);
+	return true;
+}
+}  // namespace
+
+CompressorDELTA::size_type CompressorDELTA::maxSizeImpl() const
+{
+	return std::numeric_limits<size_type>::max();
+}
+
+CompressorDELTA::size_type CompressorDELTA::compressBoundImpl(
+    size_type uncompressed_size) const
+{
+	return uncompressed_size;
+}
+
+CompressorDELTA::size_type CompressorDELTA::compress(std::byte const* src, std::byte* dst,
+                                                     size_type src_size,
+                                                     size_type dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size ||
+	    !filter<Delta, true>(src, dst, src_size, element_size)) {
+		return 0;
+	}
+	return src_size;
+}
+
+CompressorDELTA::size_type CompressorDELTA::decompress(std::byte const* src,
+                                                       std::byte* dst, size_type src_size,
+                                                       size_type dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size ||
+	    !filter<Delta, false>(src, dst, src_size, element_size)) {
+		return 0;
+	}
+	return src_size;
+}
+
+std::vector<std::byte> CompressorDELTA::parameters() const
+{
+	return detail::elementSizeParameters(element_size);
+}
+
+void CompressorDELTA::setParameters(std::byte const* data, size_type size)
+{
+	element_size = detail::elementSize("CompressorDELTA", data, size, 1, 8, true);
+}
+
+CompressorXOR::size_type CompressorXOR::maxSizeImpl() const
+{
+	return std::numeric_limits<size_type>::max();
+}
+
+CompressorXOR::size_type CompressorXOR::compressBoundImpl(
+    size_type uncompressed_size) const
+{
+	return uncompressed_size;
+}
+
+CompressorXOR::size_type CompressorXOR::compress(std::byte const* src, std::byte* dst,
+                                                 size_type src_size,
+                                                 size_type dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size ||
+	    !filter<Xor, true>(src, dst, src_size, element_size)) {
+		return 0;
+	}
+	return src_size;
+}
+
+CompressorXOR::size_type CompressorXOR::decompress(std::byte const* src, std::byte* dst,
+                                                   size_type src_size,
+                                                   size_type dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size ||
+	    !filter<Xor, false>(src, dst, src_size, element_size)) {
+		return 0;
+	}
+	return src_size;
+}
+
+std::vector<std::byte> CompressorXOR::parameters() const
+{
+	return detail::elementSizeParameters(element_size);
+}
+
+void CompressorXOR::setParameters(std::byte const* data, size_type size)
+{
+	element_size = detail::elementSize("CompressorXOR", data, size, 1, 8, true);
+}
+}  // namespace ufo
\ No newline at end of file
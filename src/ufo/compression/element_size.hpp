@@ -0,0 +1,92 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef UFO_COMPRESSION_ELEMENT_SIZE_HPP
+#define UFO_COMPRESSION_ELEMENT_SIZE_HPP
+
+// UFO
+#include <ufo/compression/compressor.hpp>
+
+// STL
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ufo::detail
+{
+/*
+ * The parameters of the filters that work on fixed-width elements: the element size as
+ * a u32.
+ */
+[[nodiscard]] inline std::vector<std::byte> elementSizeParameters(
+    std::size_t element_size)
+{
+	auto                   value = static_cast<std::uint32_t>(element_size);
+	std::vector<std::byte> parameters(sizeof(value));
+	std::memcpy(parameters.data(), &value, sizeof(value));
+	return parameters;
+}
+
+/*
+ * Reverses `elementSizeParameters`, accepting element sizes in `[min, max]` that are
+ * also a power of two if `power_of_two` is set. Throws for anything else, naming the
+ * compressor `name`.
+ */
+[[nodiscard]] inline std::size_t elementSize(char const* name, std::byte const* data,
+                                             Compressor::size_type size, std::size_t min,
+                                             std::size_t max, bool power_of_two = false)
+{
+	std::uint32_t value{};
+	if (sizeof(value) == size) {
+		std::memcpy(&value, data, sizeof(value));
+	}
+	if (0 == value || min > value || max < value ||
+	    (power_of_two && 0 != (value & (value - 1)))) {
+		throw std::runtime_error(std::string("ufo::") + name + ": invalid parameters");
+	}
+	return value;
+}
+}  // namespace ufo::detail
+
+#endif  // UFO_COMPRESSION_ELEMENT_SIZE_HPP
\ No newline at end of file
@@ -44,10 +44,248 @@
 
 // LZ4
 #include <lz4.h>
+#include <lz4frame.h>
 #include <lz4hc.h>
 
+// STL
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+
 namespace ufo
 {
+namespace
+{
+void check(LZ4F_errorCode_t code)
+{
+	if (LZ4F_isError(code)) {
+		throw std::runtime_error(std::string("ufo::CompressorLZ4: ") +
+		                         LZ4F_getErrorName(code));
+	}
+}
+
+struct StreamDeleter {
+	void operator()(LZ4_stream_t* state) const { LZ4_freeStream(state); }
+};
+
+struct StreamHCDeleter {
+	void operator()(LZ4_streamHC_t* state) const { LZ4_freeStreamHC(state); }
+};
+
+// The one-shot functions set up a fresh state on every call (LZ4_compress_HC even
+// allocates it), so each thread keeps one of each around instead.
+LZ4_stream_t* threadStream()
+{
+	thread_local std::unique_ptr<LZ4_stream_t, StreamDeleter> state(LZ4_createStream());
+	return state.get();
+}
+
+LZ4_streamHC_t* threadStreamHC()
+{
+	thread_local std::unique_ptr<LZ4_streamHC_t, StreamHCDeleter> state(
+	    LZ4_createStreamHC());
+	return state.get();
+}
+
+/*
+ * The LZ4 frame API only writes output if there is room for the worst case, so it
+ * writes to an internal buffer that is then drained into the output.
+ */
+class LZ4CompressStream final : public Compressor::Stream
+{
+ public:
+	static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+	LZ4CompressStream(int acceleration, int compression_level)
+	{
+		check(LZ4F_createCompressionContext(&ctx_, LZ4F_VERSION));
+
+		// Negative levels in the frame API are the acceleration of LZ4_compress_fast
+		prefs_.compressionLevel = 0 < compression_level ? compression_level
+		                          : 1 < acceleration    ? -acceleration
+		                                                : 0;
+
+		cap_ = std::max(LZ4F_compressBound(CHUNK_SIZE, &prefs_),
+		                static_cast<std::size_t>(LZ4F_HEADER_SIZE_MAX));
+		buf_ = std::make_unique<std::byte[]>(cap_);
+	}
+
+	~LZ4CompressStream() override { LZ4F_freeCompressionContext(ctx_); }
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool finish) override
+	{
+		while (true) {
+			auto n = std::min<std::size_t>(end_ - begin_, dst_end - dst);
+			std::memcpy(dst, buf_.get() + begin_, n);
+			dst += n;
+			begin_ += n;
+			if (begin_ != end_) {
+				return false;
+			}
+
+			begin_ = 0;
+			if (!started_) {
+				end_     = LZ4F_compressBegin(ctx_, buf_.get(), cap_, &prefs_);
+				started_ = true;
+			} else if (src != src_end) {
+				auto size = std::min<std::size_t>(CHUNK_SIZE, src_end - src);
+				end_      = LZ4F_compressUpdate(ctx_, buf_.get(), cap_, src, size, nullptr);
+				src += size;
+			} else if (finish && !ended_) {
+				end_   = LZ4F_compressEnd(ctx_, buf_.get(), cap_, nullptr);
+				ended_ = true;
+			} else {
+				end_ = 0;
+				return ended_;
+			}
+			check(end_);
+		}
+	}
+
+ private:
+	LZ4F_cctx*                   ctx_ = nullptr;
+	LZ4F_preferences_t           prefs_{};
+	std::unique_ptr<std::byte[]> buf_;
+	std::size_t                  cap_{};
+	std::size_t                  begin_{};
+	std::size_t                  end_{};
+	bool                         started_ = false;
+	bool                         ended_   = false;
+};
+
+class LZ4DecompressStream final : public Compressor::Stream
+{
+ public:
+	LZ4DecompressStream() { check(LZ4F_createDecompressionContext(&ctx_, LZ4F_VERSION)); }
+
+	~LZ4DecompressStream() override { LZ4F_freeDecompressionContext(ctx_); }
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool /* finish */) override
+	{
+		std::size_t src_size = src_end - src;
+		std::size_t dst_size = dst_end - dst;
+
+		auto hint = LZ4F_decompress(ctx_, dst, &dst_size, src, &src_size, nullptr);
+		check(hint);
+
+		src += src_size;
+		dst += dst_size;
+		// 0 means the frame has been fully decoded and flushed
+		return 0 == hint;
+	}
+
+ private:
+	LZ4F_dctx* ctx_ = nullptr;
+};
+/*
+ * Levels of the adaptive mode: LZ4_compress_fast with accelerations from
+ * 2^(NUM_FAST_LEVELS - 1) down to 1, followed by the LZ4_compress_HC levels from
+ * LZ4HC_CLEVEL_MIN up.
+ */
+constexpr int NUM_FAST_LEVELS = 6;
+
+// Farthest back LZ4 can refer to
+constexpr int HISTORY_SIZE = 64 * 1024;
+
+// Messages are copied into a buffer of this size until it is full, after which the last
+// `HISTORY_SIZE` bytes are moved to the front
+constexpr int MESSAGE_BUFFER_SIZE = 2 * HISTORY_SIZE;
+
+// FNV-1a, 0 is reserved for no dictionary
+std::uint32_t checksum(std::vector<std::byte> const& data)
+{
+	std::uint32_t hash = 2166136261u;
+	for (auto b : data) {
+		hash = (hash ^ std::to_integer<std::uint32_t>(b)) * 16777619u;
+	}
+	return 0 == hash ? 1 : hash;
+}
+
+int clampSize(Compressor::size_type size)
+{
+	return static_cast<int>(
+	    std::min<Compressor::size_type>(size, std::numeric_limits<int>::max()));
+}
+}  // namespace
+
+struct LZ4Dictionary::Impl {
+	std::vector<std::byte> data;
+	std::uint32_t          id;
+
+	// `data` loaded, to be attached to (or copied into) the state of a one-shot call
+	std::unique_ptr<LZ4_stream_t, StreamDeleter> stream;
+
+	// `data` loaded for each HC level, found without locking. How LZ4 loads a dictionary
+	// depends on the level, so they cannot share one state.
+	std::array<std::atomic<LZ4_streamHC_t const*>, LZ4HC_CLEVEL_MAX + 1> levels{};
+
+	std::mutex mutex;
+	std::array<std::unique_ptr<LZ4_streamHC_t, StreamHCDeleter>, LZ4HC_CLEVEL_MAX + 1>
+	    streams_hc;
+
+	// Loaded for `level` on first use, to be copied into the state of a one-shot call
+	LZ4_streamHC_t const* streamHC(int level)
+	{
+		// LZ4 treats the levels above the maximum as the maximum
+		auto i = static_cast<std::size_t>(std::clamp(level, 1, LZ4HC_CLEVEL_MAX));
+		if (auto stream = levels[i].load(std::memory_order_acquire)) {
+			return stream;
+		}
+
+		std::lock_guard lock(mutex);
+		auto&           stream = streams_hc[i];
+		if (!stream) {
+			stream.reset(LZ4_createStreamHC());
+			if (!stream) {
+				return nullptr;
+			}
+			LZ4_setCompressionLevel(stream.get(), static_cast<int>(i));
+			LZ4_loadDictHC(stream.get(), reinterpret_cast<char const*>(data.data()),
+			               static_cast<int>(data.size()));
+			levels[i].store(stream.get(), std::memory_order_release);
+		}
+		return stream.get();
+	}
+};
+
+LZ4Dictionary::LZ4Dictionary(std::vector<std::byte> data)
+{
+	if (data.empty()) {
+		throw std::invalid_argument("ufo::LZ4Dictionary: empty dictionary");
+	}
+	if (HISTORY_SIZE < data.size()) {
+		data.erase(data.begin(), data.end() - HISTORY_SIZE);
+	}
+
+	auto impl = std::make_shared<Impl>();
+	impl->id  = checksum(data);
+	impl->stream.reset(LZ4_createStream());
+	if (!impl->stream) {
+		throw std::bad_alloc();
+	}
+	impl->data = std::move(data);
+	LZ4_loadDict(impl->stream.get(), reinterpret_cast<char const*>(impl->data.data()),
+	             static_cast<int>(impl->data.size()));
+	impl_ = std::move(impl);
+}
+
+std::uint32_t LZ4Dictionary::id() const noexcept { return impl_ ? impl_->id : 0; }
+
+std::vector<std::byte> const& LZ4Dictionary::data() const
+{
+	static std::vector<std::byte> const empty;
+	return impl_ ? impl_->data : empty;
+}
+
 CompressorLZ4::size_type CompressorLZ4::maxSizeImpl() const
 {
 	return static_cast<size_type>(LZ4_MAX_INPUT_SIZE);
@@ -56,29 +294,299 @@ CompressorLZ4::size_type CompressorLZ4::maxSizeImpl() const
 CompressorLZ4::size_type CompressorLZ4::compressBoundImpl(
     size_type uncompressed_size) const
 {
-	return static_cast<size_type>(LZ4_compressBound(LZ4_MAX_INPUT_SIZE));
+	return static_cast<size_type>(LZ4_compressBound(static_cast<int>(uncompressed_size)));
 }
 
 CompressorLZ4::size_type CompressorLZ4::compress(std::byte const* src, std::byte* dst,
                                                  size_type src_size,
                                                  size_type dst_cap) const
 {
+	auto in      = reinterpret_cast<char const*>(src);
+	auto out     = reinterpret_cast<char*>(dst);
+	auto in_size = static_cast<int>(src_size);
+	auto out_cap = static_cast<int>(dst_cap);
+
+	if (0 < compression_level) {
+		auto state = threadStreamHC();
+		if (!state) {
+			return 0;
+		}
+		if (dictionary) {
+			auto dict = dictionary.impl_->streamHC(compression_level);
+			if (!dict) {
+				return 0;
+			}
+			// Cheaper than loading the dictionary again
+			std::memcpy(state, dict, sizeof(LZ4_streamHC_t));
+			return static_cast<size_type>(
+			    LZ4_compress_HC_continue(state, in, out, in_size, out_cap));
+		}
+		// Only clears the parts of the state that the previous call used
+		LZ4_resetStreamHC_fast(state, compression_level);
+		return static_cast<size_type>(
+		    LZ4_compress_HC_continue(state, in, out, in_size, out_cap));
+	}
+
+	auto state = threadStream();
+	if (!state) {
+		return 0;
+	}
+	if (dictionary) {
+		// Cheaper than loading the dictionary again
+#if LZ4_VERSION_NUMBER >= 11000
+		LZ4_resetStream_fast(state);
+		LZ4_attach_dictionary(state, dictionary.impl_->stream.get());
+#else
+		std::memcpy(state, dictionary.impl_->stream.get(), sizeof(LZ4_stream_t));
+#endif
+		return static_cast<size_type>(
+		    LZ4_compress_fast_continue(state, in, out, in_size, out_cap, acceleration));
+	}
+#if LZ4_VERSION_NUMBER >= 11000
+	// Only clears the parts of the state that the previous call used
+	return static_cast<size_type>(LZ4_compress_fast_extState_fastReset(
+	    state, in, out, in_size, out_cap, acceleration));
+#else
 	return static_cast<size_type>(
-	    0 < compression_level
-	        ? LZ4_compress_HC(reinterpret_cast<char const*>(src),
-	                          reinterpret_cast<char*>(dst), static_cast<int>(src_size),
-	                          static_cast<int>(dst_cap), compression_level)
-	        : LZ4_compress_fast(reinterpret_cast<char const*>(src),
-	                            reinterpret_cast<char*>(dst), static_cast<int>(src_size),
-	                            static_cast<int>(dst_cap), acceleration));
+	    LZ4_compress_fast_extState(state, in, out, in_size, out_cap, acceleration));
+#endif
 }
 
 CompressorLZ4::size_type CompressorLZ4::decompress(std::byte const* src, std::byte* dst,
                                                    size_type src_size,
                                                    size_type dst_cap) const
 {
-	return static_cast<std::size_t>(LZ4_decompress_safe(
-	    reinterpret_cast<char const*>(src), reinterpret_cast<char*>(dst),
-	    static_cast<int>(src_size), static_cast<int>(dst_cap)));
+	auto in      = reinterpret_cast<char const*>(src);
+	auto out     = reinterpret_cast<char*>(dst);
+	auto in_size = static_cast<int>(src_size);
+	auto out_cap = static_cast<int>(dst_cap);
+
+	int size;
+	if (dictionary) {
+		auto const& dict = dictionary.data();
+		size = LZ4_decompress_safe_usingDict(in, out, in_size, out_cap,
+		                                     reinterpret_cast<char const*>(dict.data()),
+		                                     static_cast<int>(dict.size()));
+	} else {
+		size = LZ4_decompress_safe(in, out, in_size, out_cap);
+	}
+	return 0 > size ? 0 : static_cast<size_type>(size);
+}
+
+std::unique_ptr<Compressor::Stream> CompressorLZ4::compressStream() const
+{
+	// The frame API only takes a dictionary through its static-linking-only functions,
+	// so chunks compressed by `compress` are used instead
+	if (dictionary) {
+		return Compressor::compressStream();
+	}
+	return std::make_unique<LZ4CompressStream>(acceleration, compression_level);
+}
+
+std::unique_ptr<Compressor::Stream> CompressorLZ4::decompressStream() const
+{
+	if (dictionary) {
+		return Compressor::decompressStream();
+	}
+	return std::make_unique<LZ4DecompressStream>();
+}
+
+int CompressorLZ4::numLevels() const
+{
+	return NUM_FAST_LEVELS + LZ4HC_CLEVEL_MAX - LZ4HC_CLEVEL_MIN + 1;
+}
+
+int CompressorLZ4::level() const
+{
+	if (0 < compression_level) {
+		return NUM_FAST_LEVELS +
+		       std::clamp(compression_level, LZ4HC_CLEVEL_MIN, LZ4HC_CLEVEL_MAX) -
+		       LZ4HC_CLEVEL_MIN;
+	}
+
+	int doublings{};
+	for (auto a = acceleration; 1 < a && NUM_FAST_LEVELS - 1 > doublings; a /= 2) {
+		++doublings;
+	}
+	return NUM_FAST_LEVELS - 1 - doublings;
+}
+
+void CompressorLZ4::setLevel(int level)
+{
+	if (NUM_FAST_LEVELS > level) {
+		acceleration      = 1 << (NUM_FAST_LEVELS - 1 - level);
+		compression_level = 0;
+	} else {
+		compression_level = LZ4HC_CLEVEL_MIN + level - NUM_FAST_LEVELS;
+	}
+}
+
+std::vector<std::byte> CompressorLZ4::parameters() const
+{
+	if (!dictionary) {
+		return {};
+	}
+	std::vector<std::byte> parameters(sizeof(std::uint32_t));
+	auto                   id = dictionary.id();
+	std::memcpy(parameters.data(), &id, sizeof(id));
+	return parameters;
+}
+
+void CompressorLZ4::setParameters(std::byte const* data, size_type size)
+{
+	if (0 == size) {
+		dictionary = {};
+		return;
+	}
+	if (sizeof(std::uint32_t) != size) {
+		throw std::runtime_error("ufo::CompressorLZ4: invalid parameters");
+	}
+
+	std::uint32_t id;
+	std::memcpy(&id, data, sizeof(id));
+	if (dictionary.id() != id) {
+		throw std::runtime_error("ufo::CompressorLZ4: dictionary " + std::to_string(id) +
+		                         " required");
+	}
+}
+
+struct LZ4MessageEncoder::State {
+	std::unique_ptr<LZ4_stream_t, StreamDeleter> stream{LZ4_createStream()};
+	std::unique_ptr<char[]>                      buffer{new char[MESSAGE_BUFFER_SIZE]};
+	int                                          pos{};
+	int                                          acceleration;
+	LZ4Dictionary                                dictionary;
+};
+
+LZ4MessageEncoder::LZ4MessageEncoder(int acceleration, LZ4Dictionary dictionary)
+    : state_(std::make_unique<State>())
+{
+	if (!state_->stream) {
+		throw std::bad_alloc();
+	}
+	state_->acceleration = acceleration;
+	state_->dictionary   = std::move(dictionary);
+	reset();
+}
+
+LZ4MessageEncoder::LZ4MessageEncoder(LZ4MessageEncoder&&) noexcept = default;
+
+LZ4MessageEncoder::~LZ4MessageEncoder() = default;
+
+LZ4MessageEncoder& LZ4MessageEncoder::operator=(LZ4MessageEncoder&&) noexcept = default;
+
+LZ4MessageEncoder::size_type LZ4MessageEncoder::compressBound(size_type size)
+{
+	return static_cast<size_type>(LZ4_compressBound(static_cast<int>(size)));
+}
+
+LZ4MessageEncoder::size_type LZ4MessageEncoder::compress(std::byte const* src,
+                                                         size_type size, std::byte* dst,
+                                                         size_type dst_cap)
+{
+	if (static_cast<size_type>(LZ4_MAX_INPUT_SIZE) < size) {
+		throw std::invalid_argument("ufo::LZ4MessageEncoder: message too large");
+	}
+
+	auto& s        = *state_;
+	auto  src_size = static_cast<int>(size);
+
+	// LZ4 refers to the previous messages where they were compressed, so they are kept
+	// in the buffer. Messages too large for it are compressed where they are and their
+	// end copied to it afterwards.
+	if (MESSAGE_BUFFER_SIZE - s.pos < src_size) {
+		s.pos = LZ4_saveDict(s.stream.get(), s.buffer.get(), HISTORY_SIZE);
+	}
+	auto in     = reinterpret_cast<char const*>(src);
+	auto copied = MESSAGE_BUFFER_SIZE - s.pos >= src_size;
+	if (copied) {
+		std::copy_n(src, size, reinterpret_cast<std::byte*>(s.buffer.get() + s.pos));
+		in = s.buffer.get() + s.pos;
+	}
+
+	auto compressed_size =
+	    LZ4_compress_fast_continue(s.stream.get(), in, reinterpret_cast<char*>(dst),
+	                               src_size, clampSize(dst_cap), s.acceleration);
+	if (0 >= compressed_size) {
+		// The decoder cannot follow anymore either way
+		reset();
+		throw std::runtime_error("ufo::LZ4MessageEncoder: compression failed");
+	}
+
+	if (copied) {
+		s.pos += src_size;
+	} else {
+		s.pos = LZ4_saveDict(s.stream.get(), s.buffer.get(), HISTORY_SIZE);
+	}
+	return static_cast<size_type>(compressed_size);
+}
+
+void LZ4MessageEncoder::reset()
+{
+	auto const& dict = state_->dictionary.data();
+	LZ4_loadDict(state_->stream.get(), reinterpret_cast<char const*>(dict.data()),
+	             static_cast<int>(dict.size()));
+	state_->pos = 0;
+}
+
+struct LZ4MessageDecoder::State {
+	std::unique_ptr<char[]> buffer{new char[MESSAGE_BUFFER_SIZE]};
+	int                     begin{};
+	int                     end{};
+	LZ4Dictionary           dictionary;
+};
+
+LZ4MessageDecoder::LZ4MessageDecoder(LZ4Dictionary dictionary)
+    : state_(std::make_unique<State>())
+{
+	state_->dictionary = std::move(dictionary);
+	reset();
+}
+
+LZ4MessageDecoder::LZ4MessageDecoder(LZ4MessageDecoder&&) noexcept = default;
+
+LZ4MessageDecoder::~LZ4MessageDecoder() = default;
+
+LZ4MessageDecoder& LZ4MessageDecoder::operator=(LZ4MessageDecoder&&) noexcept = default;
+
+LZ4MessageDecoder::size_type LZ4MessageDecoder::decompress(std::byte const* src,
+                                                           size_type        size,
+                                                           std::byte*       dst,
+                                                           size_type        dst_cap)
+{
+	auto& s   = *state_;
+	auto  out = reinterpret_cast<char*>(dst);
+
+	auto n = LZ4_decompress_safe_usingDict(reinterpret_cast<char const*>(src), out,
+	                                       clampSize(size), clampSize(dst_cap),
+	                                       s.buffer.get() + s.begin, s.end - s.begin);
+	if (0 > n) {
+		throw std::runtime_error("ufo::LZ4MessageDecoder: corrupt or out of order message");
+	}
+
+	// Keep the last `HISTORY_SIZE` bytes of the messages for the next one
+	if (HISTORY_SIZE <= n) {
+		std::memcpy(s.buffer.get(), out + n - HISTORY_SIZE, HISTORY_SIZE);
+		s.end = HISTORY_SIZE;
+	} else {
+		if (MESSAGE_BUFFER_SIZE - s.end < n) {
+			auto keep = std::min(s.end - s.begin, HISTORY_SIZE);
+			std::memmove(s.buffer.get(), s.buffer.get() + s.end - keep, keep);
+			s.end = keep;
+		}
+		std::memcpy(s.buffer.get() + s.end, out, n);
+		s.end += n;
+	}
+	s.begin = std::max(0, s.end - HISTORY_SIZE);
+
+	return static_cast<size_type>(n);
+}
+
+void LZ4MessageDecoder::reset()
+{
+	auto const& dict = state_->dictionary.data();
+	std::copy(dict.begin(), dict.end(), reinterpret_cast<std::byte*>(state_->buffer.get()));
+	state_->begin = 0;
+	state_->end   = static_cast<int>(dict.size());
 }
 }  // namespace ufo
\ No newline at end of file
@@ -47,8 +47,68 @@ extern "C" {
 #include <lzf.h>
 }
 
+// STL
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+// LZF_HSLOT from lzfP.h, which is not meant to be included from C++: the hash table
+// holds offsets on 64-bit platforms and pointers otherwise
+using LZF_HSLOT = std::conditional_t<(UINTPTR_MAX > 0xffffffffU), unsigned int,
+                                     unsigned char const*>;
+
+// The compressor built with LZF_STATE_ARG for each hash table size (see
+// 3rdparty/lzf/CMakeLists.txt)
+extern "C" {
+unsigned int lzf_compress_h10(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h11(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h12(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h13(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h14(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h15(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h16(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h17(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+unsigned int lzf_compress_h18(void const*, unsigned int, void*, unsigned int, LZF_HSLOT*);
+}
+
 namespace ufo
 {
+namespace
+{
+using CompressFn = unsigned int (*)(void const*, unsigned int, void*, unsigned int,
+                                    LZF_HSLOT*);
+
+constexpr CompressFn COMPRESS[] = {
+    lzf_compress_h10, lzf_compress_h11, lzf_compress_h12,
+    lzf_compress_h13, lzf_compress_h14, lzf_compress_h15,
+    lzf_compress_h16, lzf_compress_h17, lzf_compress_h18,
+};
+
+static_assert(std::size(COMPRESS) ==
+              CompressorLZF::MAX_HASH_LOG - CompressorLZF::MIN_HASH_LOG + 1);
+
+/*
+ * Hash table with at least `1 << hash_log` entries, kept per thread instead of being
+ * placed on the stack (256 KiB with the default HLOG) on every call. It is not cleared
+ * between calls, lzf_compress verifies every match so stale entries only affect which
+ * matches are found, the same as the uninitialized table it replaces (INIT_HTAB is 0).
+ */
+LZF_HSLOT* threadHashTable(int hash_log)
+{
+	thread_local std::unique_ptr<LZF_HSLOT[]> table;
+	thread_local std::size_t                  size{};
+
+	std::size_t needed = std::size_t(1) << hash_log;
+	if (size < needed) {
+		table = std::make_unique<LZF_HSLOT[]>(needed);
+		size  = needed;
+	}
+	return table.get();
+}
+}  // namespace
+
 CompressorLZF::size_type CompressorLZF::maxSizeImpl() const
 {
 	return std::numeric_limits<unsigned int>::max();
@@ -57,15 +117,19 @@ CompressorLZF::size_type CompressorLZF::maxSizeImpl() const
 CompressorLZF::size_type CompressorLZF::compressBoundImpl(
     size_type uncompressed_size) const
 {
-	return static_cast<size_type>(std::ceil(1.04 * static_cast<double>(uncompressed_size)));
+	// lzf_compress wants a few bytes of slack at the end, beyond its 104% worst case
+	auto bound = std::ceil(1.04 * static_cast<double>(uncompressed_size));
+	return static_cast<size_type>(bound) + 4;
 }
 
 CompressorLZF::size_type CompressorLZF::compress(std::byte const* src, std::byte* dst,
                                                  size_type src_size,
                                                  size_type dst_cap) const
 {
-	return lzf_compress(src, static_cast<unsigned int>(src_size), dst,
-	                    static_cast<unsigned int>(dst_cap));
+	auto hlog = std::clamp(hash_log, MIN_HASH_LOG, MAX_HASH_LOG);
+	return COMPRESS[hlog - MIN_HASH_LOG](src, static_cast<unsigned int>(src_size), dst,
+	                                     static_cast<unsigned int>(dst_cap),
+	                                     threadHashTable(hlog));
 }
 
 CompressorLZF::size_type CompressorLZF::decompress(std::byte const* src, std::byte* dst,
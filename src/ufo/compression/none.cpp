@@ -42,8 +42,28 @@
 //  UFO
 #include <ufo/compression/none.hpp>
 
+// STL
+#include <algorithm>
+
 namespace ufo
 {
+namespace
+{
+class NONEStream final : public Compressor::Stream
+{
+ public:
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool finish) override
+	{
+		auto n = std::min(src_end - src, dst_end - dst);
+		std::memcpy(dst, src, n);
+		src += n;
+		dst += n;
+		return finish && src == src_end;
+	}
+};
+}  // namespace
+
 CompressorNONE::size_type CompressorNONE::maxSizeImpl() const
 {
 	return std::numeric_limits<size_type>::max();
@@ -72,4 +92,14 @@ CompressorNONE::size_type CompressorNONE::decompress(std::byte const* src, std::
 	std::memcpy(dst, src, src_size);
 	return src_size;
 }
+
+std::unique_ptr<Compressor::Stream> CompressorNONE::compressStream() const
+{
+	return std::make_unique<NONEStream>();
+}
+
+std::unique_ptr<Compressor::Stream> CompressorNONE::decompressStream() const
+{
+	return std::make_unique<NONEStream>();
+}
 }  // namespace ufo
\ No newline at end of file
@@ -0,0 +1,266 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//  UFO
+#include <ufo/compression/quantize.hpp>
+
+// STL
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// SIMD
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace ufo
+{
+namespace
+{
+using size_type = Compressor::size_type;
+
+/*
+ * Compressed layout: the number of bytes after the last whole float (one byte), the
+ * quantized values, and those bytes.
+ */
+constexpr size_type HEADER_SIZE = 1;
+
+[[nodiscard]] bool valid(float min_value, float max_value, int bits)
+{
+	return std::isfinite(min_value) && std::isfinite(max_value) && min_value < max_value &&
+	       (8 == bits || 16 == bits);
+}
+
+[[nodiscard]] float levels(int bits) { return static_cast<float>((1u << bits) - 1); }
+
+template <class T>
+void quantize(std::byte const* src, std::byte* dst, size_type num, float min_value,
+              float scale)
+{
+	float const top = std::numeric_limits<T>::max();
+
+	size_type i{};
+#if defined(__SSE2__)
+	auto const vmin   = _mm_set1_ps(min_value);
+	auto const vscale = _mm_set1_ps(scale);
+	auto const vtop   = _mm_set1_ps(top);
+	auto const zero   = _mm_setzero_ps();
+	for (; num >= i + 8; i += 8) {
+		auto in = reinterpret_cast<float const*>(src) + i;
+		// Max before min, as max returns its second operand (0) for NaN
+		auto a = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(in), vmin), vscale);
+		auto b = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(in + 4), vmin), vscale);
+		auto qa = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(a, zero), vtop));
+		auto qb = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(b, zero), vtop));
+		if constexpr (1 == sizeof(T)) {
+			auto q = _mm_packus_epi16(_mm_packs_epi32(qa, qb), _mm_setzero_si128());
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), q);
+		} else {
+			// The pack saturates to signed 16 bits, so it is done on values shifted by 2^15
+			auto bias = _mm_set1_epi32(1 << 15);
+			auto q    = _mm_packs_epi32(_mm_sub_epi32(qa, bias), _mm_sub_epi32(qb, bias));
+			q         = _mm_xor_si128(q, _mm_set1_epi16(std::numeric_limits<short>::min()));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), q);
+		}
+	}
+#endif
+	for (; num > i; ++i) {
+		float value;
+		std::memcpy(&value, src + 4 * i, sizeof(value));
+		auto x = (value - min_value) * scale;
+		auto q = static_cast<T>(std::lrint(x > 0.0f ? std::min(x, top) : 0.0f));
+		std::memcpy(dst + sizeof(T) * i, &q, sizeof(T));
+	}
+}
+
+template <class T>
+void dequantize(std::byte const* src, std::byte* dst, size_type num, float min_value,
+                float step)
+{
+	size_type i{};
+#if defined(__SSE2__)
+	auto const vmin  = _mm_set1_ps(min_value);
+	auto const vstep = _mm_set1_ps(step);
+	auto const zero  = _mm_setzero_si128();
+	for (; num >= i + 8; i += 8) {
+		__m128i q;
+		if constexpr (1 == sizeof(T)) {
+			q = _mm_unpacklo_epi8(
+			    _mm_loadl_epi64(reinterpret_cast<__m128i const*>(src + i)), zero);
+		} else {
+			q = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + 2 * i));
+		}
+		auto a   = _mm_cvtepi32_ps(_mm_unpacklo_epi16(q, zero));
+		auto b   = _mm_cvtepi32_ps(_mm_unpackhi_epi16(q, zero));
+		auto out = reinterpret_cast<float*>(dst) + i;
+		_mm_storeu_ps(out, _mm_add_ps(_mm_mul_ps(a, vstep), vmin));
+		_mm_storeu_ps(out + 4, _mm_add_ps(_mm_mul_ps(b, vstep), vmin));
+	}
+#endif
+	for (; num > i; ++i) {
+		T q;
+		std::memcpy(&q, src + sizeof(T) * i, sizeof(T));
+		float value = static_cast<float>(q) * step + min_value;
+		std::memcpy(dst + 4 * i, &value, sizeof(value));
+	}
+}
+}  // namespace
+
+CompressorQUANTIZE CompressorQUANTIZE::withErrorBound(float min_value, float max_value,
+                                                      float error_bound)
+{
+	for (int bits : {8, 16}) {
+		CompressorQUANTIZE compressor(min_value, max_value, bits);
+		if (compressor.maxError() <= error_bound) {
+			return compressor;
+		}
+	}
+	throw std::invalid_argument(
+	    "ufo::CompressorQUANTIZE: error bound needs more than 16 bits");
+}
+
+float CompressorQUANTIZE::maxError() const noexcept
+{
+	return (max_value - min_value) / (2.0f * levels(bits));
+}
+
+CompressorQUANTIZE::size_type CompressorQUANTIZE::maxSizeImpl() const
+{
+	return std::numeric_limits<size_type>::max();
+}
+
+CompressorQUANTIZE::size_type CompressorQUANTIZE::compressBoundImpl(
+    size_type uncompressed_size) const
+{
+	return HEADER_SIZE + uncompressed_size;
+}
+
+CompressorQUANTIZE::size_type CompressorQUANTIZE::compress(std::byte const* src,
+                                                           std::byte*       dst,
+                                                           size_type        src_size,
+                                                           size_type dst_cap) const
+{
+	if (0 == src_size || !valid(min_value, max_value, bits)) {
+		return 0;
+	}
+
+	auto num  = src_size / sizeof(float);
+	auto tail = src_size % sizeof(float);
+	auto size = HEADER_SIZE + num * (bits / 8) + tail;
+	if (dst_cap < size) {
+		return 0;
+	}
+
+	dst[0]     = static_cast<std::byte>(tail);
+	auto scale = levels(bits) / (max_value - min_value);
+	if (8 == bits) {
+		quantize<std::uint8_t>(src, dst + HEADER_SIZE, num, min_value, scale);
+	} else {
+		quantize<std::uint16_t>(src, dst + HEADER_SIZE, num, min_value, scale);
+	}
+	std::memcpy(dst + size - tail, src + src_size - tail, tail);
+	return size;
+}
+
+CompressorQUANTIZE::size_type CompressorQUANTIZE::decompress(std::byte const* src,
+                                                             std::byte*       dst,
+                                                             size_type        src_size,
+                                                             size_type dst_cap) const
+{
+	if (HEADER_SIZE > src_size || !valid(min_value, max_value, bits)) {
+		return 0;
+	}
+
+	auto tail  = std::to_integer<size_type>(src[0]);
+	auto bytes = static_cast<size_type>(bits / 8);
+	if (sizeof(float) <= tail || src_size - HEADER_SIZE < tail ||
+	    0 != (src_size - HEADER_SIZE - tail) % bytes) {
+		return 0;
+	}
+	auto num  = (src_size - HEADER_SIZE - tail) / bytes;
+	auto size = num * sizeof(float) + tail;
+	if (dst_cap < size) {
+		return 0;
+	}
+
+	auto step = (max_value - min_value) / levels(bits);
+	if (8 == bits) {
+		dequantize<std::uint8_t>(src + HEADER_SIZE, dst, num, min_value, step);
+	} else {
+		dequantize<std::uint16_t>(src + HEADER_SIZE, dst, num, min_value, step);
+	}
+	std::memcpy(dst + size - tail, src + src_size - tail, tail);
+	return size;
+}
+
+std::vector<std::byte> CompressorQUANTIZE::parameters() const
+{
+	auto                   b = static_cast<std::uint32_t>(bits);
+	std::vector<std::byte> parameters(2 * sizeof(float) + sizeof(b));
+	std::memcpy(parameters.data(), &min_value, sizeof(float));
+	std::memcpy(parameters.data() + sizeof(float), &max_value, sizeof(float));
+	std::memcpy(parameters.data() + 2 * sizeof(float), &b, sizeof(b));
+	return parameters;
+}
+
+void CompressorQUANTIZE::setParameters(std::byte const* data, size_type size)
+{
+	float         min;
+	float         max;
+	std::uint32_t b;
+	if (2 * sizeof(float) + sizeof(b) != size) {
+		throw std::runtime_error("ufo::CompressorQUANTIZE: invalid parameters");
+	}
+	std::memcpy(&min, data, sizeof(float));
+	std::memcpy(&max, data + sizeof(float), sizeof(float));
+	std::memcpy(&b, data + 2 * sizeof(float), sizeof(b));
+	if (!valid(min, max, static_cast<int>(b))) {
+		throw std::runtime_error("ufo::CompressorQUANTIZE: invalid parameters");
+	}
+	min_value = min;
+	max_value = max;
+	bits      = static_cast<int>(b);
+}
+}  // namespace ufo
\ No newline at end of file
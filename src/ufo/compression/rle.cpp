@@ -0,0 +1,295 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//  UFO
+#include "element_size.hpp"
+#include "simd.hpp"
+#include <ufo/compression/rle.hpp>
+
+// STL
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace ufo
+{
+namespace
+{
+using size_type = Compressor::size_type;
+
+// Tail byte count, followed by the tokens and the tail bytes
+constexpr size_type HEADER_SIZE     = 1;
+constexpr size_type MAX_VARINT_SIZE = 10;
+
+#if defined(UFO_AVX2)
+// Like `runEnd`, 32 bytes at a time, returning where it stopped if it found no end
+UFO_TARGET_AVX2 size_type runEndAVX2(std::byte const* src, size_type begin,
+                                     size_type end, size_type element_size, bool& found)
+{
+	auto i = begin;
+	for (; end >= i + 32; i += 32) {
+		auto a = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i));
+		auto b =
+		    _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + i - element_size));
+		auto mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b)));
+		if (0xFFFFFFFFu != mask) {
+			found = true;
+			return i + static_cast<size_type>(__builtin_ctz(~mask));
+		}
+	}
+	return i;
+}
+#endif
+
+/*
+ * Returns the first byte in [begin, end) that differs from the byte `element_size`
+ * before it, or `end`. Element `i` starts a run that ends at the element holding that
+ * byte, if `begin` is the start of element `i + 1`.
+ */
+size_type runEnd(std::byte const* src, size_type begin, size_type end,
+                 size_type element_size)
+{
+	auto i = begin;
+#if defined(UFO_AVX2)
+	if (detail::hasAVX2()) {
+		bool found{};
+		i = runEndAVX2(src, begin, end, element_size, found);
+		if (found) {
+			return i;
+		}
+	}
+#endif
+#if defined(__SSE2__)
+	for (; end >= i + 16; i += 16) {
+		auto a    = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i));
+		auto b    = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i - element_size));
+		auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)));
+		if (0xFFFFu != mask) {
+			return i + static_cast<size_type>(__builtin_ctz(~mask));
+		}
+	}
+#endif
+	for (; end > i && src[i] == src[i - element_size]; ++i) {
+	}
+	return i;
+}
+
+size_type varintSize(std::uint64_t value)
+{
+	size_type size = 1;
+	for (; 0x80 <= value; value >>= 7) {
+		++size;
+	}
+	return size;
+}
+
+std::byte* writeVarint(std::byte* dst, std::uint64_t value)
+{
+	for (; 0x80 <= value; value >>= 7) {
+		*dst++ = static_cast<std::byte>(value | 0x80);
+	}
+	*dst++ = static_cast<std::byte>(value);
+	return dst;
+}
+
+// Returns nullptr if the varint is truncated or too long
+std::byte const* readVarint(std::byte const* src, std::byte const* end,
+                            std::uint64_t& value)
+{
+	value = 0;
+	for (unsigned shift{}; end > src && 64 > shift; shift += 7) {
+		auto byte = std::to_integer<std::uint64_t>(*src++);
+		value |= (byte & 0x7F) << shift;
+		if (0 == (byte & 0x80)) {
+			return src;
+		}
+	}
+	return nullptr;
+}
+
+/*
+ * Writes a token of `count` elements, a run stores a single element. Returns nullptr if
+ * it does not fit.
+ */
+std::byte* writeToken(std::byte* dst, std::byte* dst_end, std::byte const* data,
+                      size_type count, size_type element_size, bool run)
+{
+	auto header = (static_cast<std::uint64_t>(count) << 1) | (run ? 1u : 0u);
+	auto size   = run ? element_size : count * element_size;
+	if (static_cast<size_type>(dst_end - dst) < varintSize(header) + size) {
+		return nullptr;
+	}
+	dst = writeVarint(dst, header);
+	std::memcpy(dst, data, size);
+	return dst + size;
+}
+
+// Repeats the first `element_size` bytes of `dst` until `size` bytes are filled
+void fill(std::byte* dst, size_type size, size_type element_size)
+{
+	if (1 == element_size) {
+		std::memset(dst, std::to_integer<int>(dst[0]), size);
+		return;
+	}
+	for (auto filled = element_size; size > filled;) {
+		auto n = std::min(filled, size - filled);
+		std::memcpy(dst + filled, dst, n);
+		filled += n;
+	}
+}
+}  // namespace
+
+CompressorRLE::size_type CompressorRLE::maxSizeImpl() const
+{
+	return std::numeric_limits<size_type>::max() - HEADER_SIZE - MAX_VARINT_SIZE;
+}
+
+CompressorRLE::size_type CompressorRLE::compressBoundImpl(
+    size_type uncompressed_size) const
+{
+	// A run is only stored if it saves at least as much as its own header and that of
+	// the literal it splits, so nothing is ever larger than a single literal
+	return HEADER_SIZE + MAX_VARINT_SIZE + uncompressed_size;
+}
+
+CompressorRLE::size_type CompressorRLE::compress(std::byte const* src, std::byte* dst,
+                                                 size_type src_size,
+                                                 size_type dst_cap) const
+{
+	auto const e = static_cast<size_type>(element_size);
+	if (0 == src_size || 0 == e || 255 < e || HEADER_SIZE > dst_cap) {
+		return 0;
+	}
+
+	auto const num       = src_size / e;
+	auto const tail      = src_size - num * e;
+	auto const threshold = 2 * varintSize((static_cast<std::uint64_t>(num) << 1) | 1u);
+
+	auto       out     = dst;
+	auto const out_end = dst + dst_cap;
+	*out++             = static_cast<std::byte>(tail);
+
+	size_type literal{};
+	for (size_type i{}; num > i;) {
+		auto len = runEnd(src, (i + 1) * e, num * e, e) / e - i;
+		if ((len - 1) * e >= threshold) {
+			if (literal < i &&
+			    !(out = writeToken(out, out_end, src + literal * e, i - literal, e, false))) {
+				return 0;
+			}
+			if (!(out = writeToken(out, out_end, src + i * e, len, e, true))) {
+				return 0;
+			}
+			literal = i + len;
+		}
+		i += len;
+	}
+	if (literal < num &&
+	    !(out = writeToken(out, out_end, src + literal * e, num - literal, e, false))) {
+		return 0;
+	}
+
+	if (static_cast<size_type>(out_end - out) < tail) {
+		return 0;
+	}
+	std::memcpy(out, src + num * e, tail);
+	return static_cast<size_type>(out + tail - dst);
+}
+
+CompressorRLE::size_type CompressorRLE::decompress(std::byte const* src, std::byte* dst,
+                                                   size_type src_size,
+                                                   size_type dst_cap) const
+{
+	auto const e = static_cast<size_type>(element_size);
+	if (HEADER_SIZE > src_size || 0 == e || 255 < e) {
+		return 0;
+	}
+
+	auto const tail = std::to_integer<size_type>(src[0]);
+	if (tail >= e || src_size - HEADER_SIZE < tail) {
+		return 0;
+	}
+
+	auto       in     = src + HEADER_SIZE;
+	auto const in_end = src + src_size - tail;
+	size_type  size{};
+	while (in_end > in) {
+		std::uint64_t header;
+		if (!(in = readVarint(in, in_end, header))) {
+			return 0;
+		}
+		auto count = header >> 1;
+		bool run   = 0 != (header & 1u);
+		if (0 == count || (dst_cap - size) / e < count) {
+			return 0;
+		}
+
+		auto bytes = static_cast<size_type>(count) * e;
+		auto n     = run ? e : bytes;
+		if (static_cast<size_type>(in_end - in) < n) {
+			return 0;
+		}
+		std::memcpy(dst + size, in, n);
+		if (run) {
+			fill(dst + size, bytes, e);
+		}
+		in += n;
+		size += bytes;
+	}
+
+	if (dst_cap - size < tail) {
+		return 0;
+	}
+	std::memcpy(dst + size, in_end, tail);
+	return size + tail;
+}
+
+std::vector<std::byte> CompressorRLE::parameters() const
+{
+	return detail::elementSizeParameters(element_size);
+}
+
+void CompressorRLE::setParameters(std::byte const* data, size_type size)
+{
+	element_size = detail::elementSize("CompressorRLE", data, size, 1, 255);
+}
+}  // namespace ufo
\ No newline at end of file
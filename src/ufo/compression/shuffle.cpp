@@ -0,0 +1,552 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//  UFO
+#include "element_size.hpp"
+#include "simd.hpp"
+#include <ufo/compression/shuffle.hpp>
+
+// STL
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+namespace ufo
+{
+namespace
+{
+using size_type = Compressor::size_type;
+
+/*
+ * The SIMD kernels work on 16 elements per 128-bit lane. Seen as one array of 16 * E
+ * bytes, `interleave` interleaves its first and second half `rounds` times, which
+ * rotates the bits of each byte's index left by `rounds`. Four rounds therefore turn 16
+ * elements of E bytes into E rows of 16 bytes, and log2(E) rounds turn them back.
+ */
+#if defined(__SSE2__)
+inline __m128i unpackLo(__m128i a, __m128i b) { return _mm_unpacklo_epi8(a, b); }
+
+inline __m128i unpackHi(__m128i a, __m128i b) { return _mm_unpackhi_epi8(a, b); }
+#endif
+
+#if defined(UFO_AVX2)
+// Per 128-bit lane, so each lane holds its own 16 elements
+UFO_TARGET_AVX2 inline __m256i unpackLo(__m256i a, __m256i b)
+{
+	return _mm256_unpacklo_epi8(a, b);
+}
+
+UFO_TARGET_AVX2 inline __m256i unpackHi(__m256i a, __m256i b)
+{
+	return _mm256_unpackhi_epi8(a, b);
+}
+
+UFO_TARGET_AVX2 inline __m256i load2(std::byte const* lo, std::byte const* hi)
+{
+	return _mm256_inserti128_si256(
+	    _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(lo))),
+	    _mm_loadu_si128(reinterpret_cast<__m128i const*>(hi)), 1);
+}
+
+UFO_TARGET_AVX2 inline void store2(std::byte* lo, std::byte* hi, __m256i v)
+{
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(lo), _mm256_castsi256_si128(v));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(hi), _mm256_extracti128_si256(v, 1));
+}
+#endif
+
+[[nodiscard]] constexpr int log2(std::size_t e) { return 1 < e ? 1 + log2(e / 2) : 0; }
+
+#if defined(__SSE2__)
+template <std::size_t E>
+void interleave(__m128i (&v)[E], int rounds)
+{
+	if constexpr (1 < E) {
+		for (; 0 < rounds; --rounds) {
+			__m128i t[E];
+			for (std::size_t k{}; E / 2 > k; ++k) {
+				t[2 * k]     = unpackLo(v[k], v[k + E / 2]);
+				t[2 * k + 1] = unpackHi(v[k], v[k + E / 2]);
+			}
+			std::copy(std::begin(t), std::end(t), v);
+		}
+	}
+}
+#endif
+
+#if defined(UFO_AVX2)
+template <std::size_t E>
+UFO_TARGET_AVX2 void interleave(__m256i (&v)[E], int rounds)
+{
+	if constexpr (1 < E) {
+		for (; 0 < rounds; --rounds) {
+			__m256i t[E];
+			for (std::size_t k{}; E / 2 > k; ++k) {
+				t[2 * k]     = unpackLo(v[k], v[k + E / 2]);
+				t[2 * k + 1] = unpackHi(v[k], v[k + E / 2]);
+			}
+			// Not `std::copy`, which is not compiled for AVX2
+			for (std::size_t k{}; E > k; ++k) {
+				v[k] = t[k];
+			}
+		}
+	}
+}
+#endif
+
+// 8x8 bit matrix transpose, bit `c` of byte `r` becomes bit `r` of byte `c`
+[[nodiscard]] constexpr std::uint64_t transpose8(std::uint64_t x)
+{
+	std::uint64_t t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+	x               = x ^ t ^ (t << 7);
+	t               = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+	x               = x ^ t ^ (t << 14);
+	t               = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+	return x ^ t ^ (t << 28);
+}
+
+/*
+ * Byte shuffle of `num` elements, the SIMD kernels handle as many as they can and
+ * return how many that was (none when not compiled for SSE2). The AVX2 kernels go first
+ * where the CPU has AVX2, leaving the rest to the SSE2 ones.
+ */
+#if defined(UFO_AVX2)
+template <std::size_t E>
+UFO_TARGET_AVX2 size_type shuffleAVX2(std::byte const* src, std::byte* dst,
+                                      size_type num)
+{
+	size_type i{};
+	for (; num >= i + 32; i += 32) {
+		__m256i v[E];
+		for (std::size_t k{}; E > k; ++k) {
+			v[k] = load2(src + i * E + 16 * k, src + (i + 16) * E + 16 * k);
+		}
+		interleave(v, 4);
+		for (std::size_t j{}; E > j; ++j) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + j * num + i), v[j]);
+		}
+	}
+	return i;
+}
+#endif
+
+template <std::size_t E>
+size_type shuffleSIMD([[maybe_unused]] std::byte const* src,
+                      [[maybe_unused]] std::byte* dst, [[maybe_unused]] size_type num)
+{
+	size_type i{};
+#if defined(UFO_AVX2)
+	if (detail::hasAVX2()) {
+		i = shuffleAVX2<E>(src, dst, num);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; num >= i + 16; i += 16) {
+		__m128i v[E];
+		for (std::size_t k{}; E > k; ++k) {
+			v[k] = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * E + 16 * k));
+		}
+		interleave(v, 4);
+		for (std::size_t j{}; E > j; ++j) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j * num + i), v[j]);
+		}
+	}
+#endif
+	return i;
+}
+
+#if defined(UFO_AVX2)
+template <std::size_t E>
+UFO_TARGET_AVX2 size_type unshuffleAVX2(std::byte const* src, std::byte* dst,
+                                        size_type num)
+{
+	size_type i{};
+	for (; num >= i + 32; i += 32) {
+		__m256i v[E];
+		for (std::size_t j{}; E > j; ++j) {
+			v[j] = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(src + j * num + i));
+		}
+		interleave(v, log2(E));
+		for (std::size_t k{}; E > k; ++k) {
+			store2(dst + i * E + 16 * k, dst + (i + 16) * E + 16 * k, v[k]);
+		}
+	}
+	return i;
+}
+#endif
+
+template <std::size_t E>
+size_type unshuffleSIMD([[maybe_unused]] std::byte const* src,
+                        [[maybe_unused]] std::byte* dst, [[maybe_unused]] size_type num)
+{
+	size_type i{};
+#if defined(UFO_AVX2)
+	if (detail::hasAVX2()) {
+		i = unshuffleAVX2<E>(src, dst, num);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; num >= i + 16; i += 16) {
+		__m128i v[E];
+		for (std::size_t j{}; E > j; ++j) {
+			v[j] = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + j * num + i));
+		}
+		interleave(v, log2(E));
+		for (std::size_t k{}; E > k; ++k) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * E + 16 * k), v[k]);
+		}
+	}
+#endif
+	return i;
+}
+
+/*
+ * Bit shuffle of `num` elements, a multiple of 8. Each of the 8 * E rows has one bit
+ * per element, so it is `num / 8` bytes.
+ */
+#if defined(UFO_AVX2)
+template <std::size_t E>
+UFO_TARGET_AVX2 size_type bitshuffleAVX2(std::byte const* src, std::byte* dst,
+                                         size_type num)
+{
+	auto      row = num / 8;
+	size_type i{};
+	for (; num >= i + 32; i += 32) {
+		__m256i v[E];
+		for (std::size_t k{}; E > k; ++k) {
+			v[k] = load2(src + i * E + 16 * k, src + (i + 16) * E + 16 * k);
+		}
+		interleave(v, 4);
+		for (std::size_t j{}; E > j; ++j) {
+			// The highest bit of each byte, then the next after doubling, and so on
+			for (std::size_t k = 8; 0 < k--;) {
+				auto bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(v[j]));
+				std::memcpy(dst + (8 * j + k) * row + i / 8, &bits, sizeof(bits));
+				v[j] = _mm256_add_epi8(v[j], v[j]);
+			}
+		}
+	}
+	return i;
+}
+#endif
+
+template <std::size_t E>
+size_type bitshuffleSIMD([[maybe_unused]] std::byte const* src,
+                         [[maybe_unused]] std::byte* dst, [[maybe_unused]] size_type num)
+{
+	[[maybe_unused]] auto row = num / 8;
+	size_type             i{};
+#if defined(UFO_AVX2)
+	if (detail::hasAVX2()) {
+		i = bitshuffleAVX2<E>(src, dst, num);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; num >= i + 16; i += 16) {
+		__m128i v[E];
+		for (std::size_t k{}; E > k; ++k) {
+			v[k] = _mm_loadu_si128(reinterpret_cast<__m128i const*>(src + i * E + 16 * k));
+		}
+		interleave(v, 4);
+		for (std::size_t j{}; E > j; ++j) {
+			for (std::size_t k = 8; 0 < k--;) {
+				auto bits = static_cast<std::uint16_t>(_mm_movemask_epi8(v[j]));
+				std::memcpy(dst + (8 * j + k) * row + i / 8, &bits, sizeof(bits));
+				v[j] = _mm_add_epi8(v[j], v[j]);
+			}
+		}
+	}
+#endif
+	return i;
+}
+
+// Bits of element `i + r` in byte `r`, from row `row` of each bit of byte `j`
+std::uint64_t gatherBits(std::byte const* src, size_type row, std::size_t j, size_type i)
+{
+	std::uint64_t x{};
+	for (std::size_t k{}; 8 > k; ++k) {
+		x |= std::to_integer<std::uint64_t>(src[(8 * j + k) * row + i / 8]) << (8 * k);
+	}
+	return transpose8(x);
+}
+
+#if defined(UFO_AVX2)
+template <std::size_t E>
+UFO_TARGET_AVX2 size_type bitunshuffleAVX2(std::byte const* src, std::byte* dst,
+                                           size_type num)
+{
+	auto      row = num / 8;
+	size_type i{};
+	for (; num >= i + 32; i += 32) {
+		__m256i v[E];
+		for (std::size_t j{}; E > j; ++j) {
+			v[j] = _mm256_set_epi64x(static_cast<long long>(gatherBits(src, row, j, i + 24)),
+			                         static_cast<long long>(gatherBits(src, row, j, i + 16)),
+			                         static_cast<long long>(gatherBits(src, row, j, i + 8)),
+			                         static_cast<long long>(gatherBits(src, row, j, i)));
+		}
+		interleave(v, log2(E));
+		for (std::size_t k{}; E > k; ++k) {
+			store2(dst + i * E + 16 * k, dst + (i + 16) * E + 16 * k, v[k]);
+		}
+	}
+	return i;
+}
+#endif
+
+template <std::size_t E>
+size_type bitunshuffleSIMD([[maybe_unused]] std::byte const* src,
+                           [[maybe_unused]] std::byte*       dst,
+                           [[maybe_unused]] size_type        num)
+{
+	[[maybe_unused]] auto row = num / 8;
+	size_type             i{};
+#if defined(UFO_AVX2)
+	if (detail::hasAVX2()) {
+		i = bitunshuffleAVX2<E>(src, dst, num);
+	}
+#endif
+#if defined(__SSE2__)
+	for (; num >= i + 16; i += 16) {
+		__m128i v[E];
+		for (std::size_t j{}; E > j; ++j) {
+			v[j] = _mm_set_epi64x(static_cast<long long>(gatherBits(src, row, j, i + 8)),
+			                      static_cast<long long>(gatherBits(src, row, j, i)));
+		}
+		interleave(v, log2(E));
+		for (std::size_t k{}; E > k; ++k) {
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * E + 16 * k), v[k]);
+		}
+	}
+#endif
+	return i;
+}
+
+using Kernel = size_type (*)(std::byte const*, std::byte*, size_type);
+
+// Runs the kernel for `element_size` if there is one, otherwise returns 0
+size_type simd(Kernel const (&kernels)[5], std::byte const* src, std::byte* dst,
+               size_type num, std::size_t element_size)
+{
+	for (std::size_t k{}; std::size(kernels) > k; ++k) {
+		if (std::size_t(1) << k == element_size) {
+			return kernels[k](src, dst, num);
+		}
+	}
+	return 0;
+}
+
+// Indexed by the log2 of the element size
+constexpr Kernel SHUFFLE[]      = {shuffleSIMD<1>, shuffleSIMD<2>, shuffleSIMD<4>,
+                                   shuffleSIMD<8>, shuffleSIMD<16>};
+constexpr Kernel UNSHUFFLE[]    = {unshuffleSIMD<1>, unshuffleSIMD<2>,
+                                   unshuffleSIMD<4>, unshuffleSIMD<8>,
+                                   unshuffleSIMD<16>};
+constexpr Kernel BITSHUFFLE[]   = {bitshuffleSIMD<1>, bitshuffleSIMD<2>,
+                                   bitshuffleSIMD<4>, bitshuffleSIMD<8>,
+                                   bitshuffleSIMD<16>};
+constexpr Kernel BITUNSHUFFLE[] = {bitunshuffleSIMD<1>, bitunshuffleSIMD<2>,
+                                   bitunshuffleSIMD<4>, bitunshuffleSIMD<8>,
+                                   bitunshuffleSIMD<16>};
+
+void shuffle(std::byte const* src, std::byte* dst, size_type size,
+             std::size_t element_size)
+{
+	auto num = size / element_size;
+	auto i   = simd(SHUFFLE, src, dst, num, element_size);
+	for (; num > i; ++i) {
+		for (std::size_t j{}; element_size > j; ++j) {
+			dst[j * num + i] = src[i * element_size + j];
+		}
+	}
+	std::memcpy(dst + num * element_size, src + num * element_size,
+	            size - num * element_size);
+}
+
+void unshuffle(std::byte const* src, std::byte* dst, size_type size,
+               std::size_t element_size)
+{
+	auto num = size / element_size;
+	auto i   = simd(UNSHUFFLE, src, dst, num, element_size);
+	for (; num > i; ++i) {
+		for (std::size_t j{}; element_size > j; ++j) {
+			dst[i * element_size + j] = src[j * num + i];
+		}
+	}
+	std::memcpy(dst + num * element_size, src + num * element_size,
+	            size - num * element_size);
+}
+
+void bitshuffle(std::byte const* src, std::byte* dst, size_type size,
+                std::size_t element_size)
+{
+	auto num = size / element_size / 8 * 8;
+	auto row = num / 8;
+	auto i   = simd(BITSHUFFLE, src, dst, num, element_size);
+	for (; num > i; i += 8) {
+		for (std::size_t j{}; element_size > j; ++j) {
+			std::uint64_t x{};
+			for (std::size_t r{}; 8 > r; ++r) {
+				x |= std::to_integer<std::uint64_t>(src[(i + r) * element_size + j]) << (8 * r);
+			}
+			x = transpose8(x);
+			for (std::size_t k{}; 8 > k; ++k) {
+				dst[(8 * j + k) * row + i / 8] = static_cast<std::byte>(x >> (8 * k));
+			}
+		}
+	}
+	std::memcpy(dst + num * element_size, src + num * element_size,
+	            size - num * element_size);
+}
+
+void bitunshuffle(std::byte const* src, std::byte* dst, size_type size,
+                  std::size_t element_size)
+{
+	auto num = size / element_size / 8 * 8;
+	auto row = num / 8;
+	auto i   = simd(BITUNSHUFFLE, src, dst, num, element_size);
+	for (; num > i; i += 8) {
+		for (std::size_t j{}; element_size > j; ++j) {
+			auto x = gatherBits(src, row, j, i);
+			for (std::size_t r{}; 8 > r; ++r) {
+				dst[(i + r) * element_size + j] = static_cast<std::byte>(x >> (8 * r));
+			}
+		}
+	}
+	std::memcpy(dst + num * element_size, src + num * element_size,
+	            size - num * element_size);
+}
+}  // namespace
+
+CompressorSHUFFLE::size_type CompressorSHUFFLE::maxSizeImpl() const
+{
+	return std::numeric_limits<size_type>::max();
+}
+
+CompressorSHUFFLE::size_type CompressorSHUFFLE::compressBoundImpl(
+    size_type uncompressed_size) const
+{
+	return uncompressed_size;
+}
+
+CompressorSHUFFLE::size_type CompressorSHUFFLE::compress(std::byte const* src,
+                                                         std::byte*       dst,
+                                                         size_type        src_size,
+                                                         size_type        dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size) {
+		return 0;
+	}
+	shuffle(src, dst, src_size, element_size);
+	return src_size;
+}
+
+CompressorSHUFFLE::size_type CompressorSHUFFLE::decompress(std::byte const* src,
+                                                           std::byte* dst,
+                                                           size_type  src_size,
+                                                           size_type  dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size) {
+		return 0;
+	}
+	unshuffle(src, dst, src_size, element_size);
+	return src_size;
+}
+
+std::vector<std::byte> CompressorSHUFFLE::parameters() const
+{
+	return detail::elementSizeParameters(element_size);
+}
+
+void CompressorSHUFFLE::setParameters(std::byte const* data, size_type size)
+{
+	element_size = detail::elementSize("CompressorSHUFFLE", data, size, 1,
+	                                   std::numeric_limits<std::uint32_t>::max());
+}
+
+CompressorBITSHUFFLE::size_type CompressorBITSHUFFLE::maxSizeImpl() const
+{
+	return std::numeric_limits<size_type>::max();
+}
+
+CompressorBITSHUFFLE::size_type CompressorBITSHUFFLE::compressBoundImpl(
+    size_type uncompressed_size) const
+{
+	return uncompressed_size;
+}
+
+CompressorBITSHUFFLE::size_type CompressorBITSHUFFLE::compress(std::byte const* src,
+                                                               std::byte*       dst,
+                                                               size_type        src_size,
+                                                               size_type dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size) {
+		return 0;
+	}
+	bitshuffle(src, dst, src_size, element_size);
+	return src_size;
+}
+
+CompressorBITSHUFFLE::size_type CompressorBITSHUFFLE::decompress(std::byte const* src,
+                                                                 std::byte*       dst,
+                                                                 size_type src_size,
+                                                                 size_type dst_cap) const
+{
+	if (0 == src_size || 0 == element_size || dst_cap < src_size) {
+		return 0;
+	}
+	bitunshuffle(src, dst, src_size, element_size);
+	return src_size;
+}
+
+std::vector<std::byte> CompressorBITSHUFFLE::parameters() const
+{
+	return detail::elementSizeParameters(element_size);
+}
+
+void CompressorBITSHUFFLE::setParameters(std::byte const* data, size_type size)
+{
+	element_size = detail::elementSize("CompressorBITSHUFFLE", data, size, 1,
+	                                   std::numeric_limits<std::uint32_t>::max());
+}
+}  // namespace ufo
\ No newline at end of file
@@ -0,0 +1,80 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef UFO_COMPRESSION_SIMD_HPP
+#define UFO_COMPRESSION_SIMD_HPP
+
+// SIMD
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * AVX2 kernels are compiled whenever SSE2 is, and only run if `hasAVX2()`. Unless the
+ * whole build targets AVX2, they are compiled for it one function at a time through
+ * `UFO_TARGET_AVX2`, and anything they call with AVX2 types needs it as well.
+ */
+#if defined(__AVX2__)
+#define UFO_AVX2
+#define UFO_TARGET_AVX2
+#elif defined(__SSE2__) && defined(__GNUC__)
+#define UFO_AVX2
+#define UFO_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace ufo::detail
+{
+#if defined(UFO_AVX2)
+// Whether the CPU runs AVX2 instructions, always true if the build targets AVX2
+[[nodiscard]] inline bool hasAVX2()
+{
+#if defined(__AVX2__)
+	return true;
+#else
+	static bool const avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+#endif
+}
+#endif
+}  // namespace ufo::detail
+
+#endif  // UFO_COMPRESSION_SIMD_HPP
@@ -0,0 +1,279 @@
+/*!
+ * UFOMap: An Efficient Probabilistic 3D Mapping Framework That Embraces the Unknown
+ *
+ * @author Daniel Duberg (dduberg@kth.se)
+ * @see https://github.com/UnknownFreeOccupied/ufomap
+ * @version 1.0
+ * @date 2022-05-13
+ *
+ * @copyright Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ *
+ * BSD 3-Clause License
+ *
+ * Copyright (c) 2022, Daniel Duberg, KTH Royal Institute of Technology
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *     list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *     and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *     contributors may be used to endorse or promote products derived from
+ *     this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//  UFO
+#include <ufo/compression/thread_pool.hpp>
+
+// STL
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+// POSIX
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace ufo
+{
+namespace
+{
+// The pool and index of the calling thread, if it is a pool thread, and the priority of
+// the task it is running
+struct Worker {
+	void const* pool{};
+	std::size_t index{};
+	Priority    priority = Priority::NORMAL;
+};
+
+thread_local Worker worker;
+
+struct SharedState {
+	std::mutex         mutex;
+	ThreadPool::Config config;
+	bool               started = false;
+};
+
+SharedState& sharedState()
+{
+	static SharedState state;
+	return state;
+}
+
+// Marks the shared pool as started and returns its configuration
+ThreadPool::Config startShared()
+{
+	auto&            state = sharedState();
+	std::scoped_lock lock(state.mutex);
+	state.started = true;
+	return state.config;
+}
+}  // namespace
+
+ThreadPool::ThreadPool(std::size_t num_threads) : ThreadPool(Config{num_threads, {}}) {}
+
+ThreadPool::ThreadPool(Config config)
+{
+	auto num_threads = std::max(config.num_threads, std::size_t(1));
+	queues_.reserve(num_threads);
+	for (std::size_t i{}; num_threads > i; ++i) {
+		queues_.push_back(std::make_unique<Queue>());
+	}
+	threads_.reserve(num_threads);
+	for (std::size_t i{}; num_threads > i; ++i) {
+		threads_.emplace_back(&ThreadPool::run, this, i, config.cpus);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::scoped_lock lock(mutex_);
+		done_ = true;
+	}
+	cv_.notify_all();
+	for (auto& t : threads_) {
+		t.join();
+	}
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool(startShared());
+	return pool;
+}
+
+void ThreadPool::configure(Config config)
+{
+	auto&            state = sharedState();
+	std::scoped_lock lock(state.mutex);
+	if (state.started) {
+		throw std::logic_error("ufo::ThreadPool: the shared pool has already started");
+	}
+	state.config = std::move(config);
+}
+
+ThreadPool::Queue* ThreadPool::current() const noexcept
+{
+	return this == worker.pool ? queues_[worker.index].get() : nullptr;
+}
+
+Priority ThreadPool::priority() const noexcept
+{
+	return this == worker.pool ? worker.priority : Priority::NORMAL;
+}
+
+void ThreadPool::enqueue(Priority priority, Task task)
+{
+	auto p = static_cast<std::size_t>(priority);
+
+	// Counted before it is queued, such that the count never drops below zero, and under
+	// the lock the threads sleep on, such that none misses it
+	auto queue = current();
+	bool waiting;
+	{
+		std::scoped_lock lock(mutex_);
+		++num_tasks_[p];
+		if (!queue) {
+			tasks_[p].push_back(std::move(task));
+		}
+		waiting = 0 < num_waiting_;
+	}
+	if (queue) {
+		std::scoped_lock lock(queue->mutex);
+		queue->tasks[p].push_back(std::move(task));
+	}
+	cv_.notify_one();
+	if (waiting) {
+		wait_cv_.notify_all();
+	}
+}
+
+bool ThreadPool::take(std::size_t p, Task& task)
+{
+	if (0 == num_tasks_[p]) {
+		return false;
+	}
+
+	auto pop = [this, p, &task](std::deque<Task>& tasks, bool newest) {
+		if (tasks.empty()) {
+			return false;
+		}
+		if (newest) {
+			task = std::move(tasks.back());
+			tasks.pop_back();
+		} else {
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		--num_tasks_[p];
+		return true;
+	};
+
+	auto own = current();
+	if (own) {
+		std::scoped_lock lock(own->mutex);
+		if (pop(own->tasks[p], true)) {
+			return true;
+		}
+	}
+
+	{
+		std::scoped_lock lock(mutex_);
+		if (pop(tasks_[p], false)) {
+			return true;
+		}
+	}
+
+	// Steal, starting after our own queue such that not all threads go for the same one
+	auto first = own ? worker.index : 0;
+	for (std::size_t i = 1; queues_.size() >= i; ++i) {
+		auto&            queue = *queues_[(first + i) % queues_.size()];
+		std::scoped_lock lock(queue.mutex);
+		if (pop(queue.tasks[p], false)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool ThreadPool::runOne(Priority min)
+{
+	Task task;
+	for (auto p = NUM_PRIORITIES; static_cast<std::size_t>(min) < p--;) {
+		if (!take(p, task)) {
+			continue;
+		}
+
+		// Tasks are packaged and never throw
+		auto priority   = worker.priority;
+		worker.priority = static_cast<Priority>(p);
+		task();
+		worker.priority = priority;
+
+		// The task may have made ready what a waiting thread waits for. Taking the lock
+		// orders this after a waiter's check, which then either saw the task done or is
+		// asleep and counted.
+		bool waiting;
+		{
+			std::scoped_lock lock(mutex_);
+			waiting = 0 < num_waiting_;
+		}
+		if (waiting) {
+			wait_cv_.notify_all();
+		}
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::run(std::size_t index, [[maybe_unused]] std::vector<int> const& cpus)
+{
+#if defined(__linux__)
+	if (!cpus.empty()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpus[index % cpus.size()], &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+#endif
+
+	worker = {this, index};
+	while (true) {
+		if (runOne()) {
+			continue;
+		}
+
+		auto queued = [this]() {
+			return std::any_of(num_tasks_.begin(), num_tasks_.end(),
+			                   [](auto const& n) { return 0 < n; });
+		};
+
+		std::unique_lock lock(mutex_);
+		cv_.wait(lock, [this, &queued]() { return done_ || queued(); });
+		if (done_ && !queued()) {
+			return;
+		}
+	}
+}
+}  // namespace ufo
\ No newline at end of file
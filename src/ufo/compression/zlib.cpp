@@ -45,8 +45,98 @@
 // ZLIB
 #include <zlib-ng.h>
 
+// STL
+#include <algorithm>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+
 namespace ufo
 {
+namespace
+{
+// zlib counts the available input and output in 32 bits
+constexpr std::ptrdiff_t MAX_AVAIL = std::numeric_limits<std::uint32_t>::max();
+
+class ZLIBCompressStream final : public Compressor::Stream
+{
+ public:
+	explicit ZLIBCompressStream(int compression_level)
+	{
+		if (Z_OK != zng_deflateInit(&stream_, compression_level)) {
+			throw std::bad_alloc();
+		}
+	}
+
+	~ZLIBCompressStream() override { zng_deflateEnd(&stream_); }
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool finish) override
+	{
+		auto src_size = std::min(src_end - src, MAX_AVAIL);
+		auto dst_size = std::min(dst_end - dst, MAX_AVAIL);
+
+		stream_.next_in   = reinterpret_cast<std::uint8_t const*>(src);
+		stream_.avail_in  = static_cast<std::uint32_t>(src_size);
+		stream_.next_out  = reinterpret_cast<std::uint8_t*>(dst);
+		stream_.avail_out = static_cast<std::uint32_t>(dst_size);
+
+		// Only finish once all input fits in a single call
+		auto code = zng_deflate(&stream_, finish && src_end - src == src_size ? Z_FINISH
+		                                                                      : Z_NO_FLUSH);
+		if (Z_STREAM_ERROR == code) {
+			throw std::runtime_error("ufo::CompressorZLIB: compression failed");
+		}
+
+		src += src_size - stream_.avail_in;
+		dst += dst_size - stream_.avail_out;
+		return Z_STREAM_END == code;
+	}
+
+ private:
+	zng_stream stream_{};
+};
+
+class ZLIBDecompressStream final : public Compressor::Stream
+{
+ public:
+	ZLIBDecompressStream()
+	{
+		if (Z_OK != zng_inflateInit(&stream_)) {
+			throw std::bad_alloc();
+		}
+	}
+
+	~ZLIBDecompressStream() override { zng_inflateEnd(&stream_); }
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool /* finish */) override
+	{
+		auto src_size = std::min(src_end - src, MAX_AVAIL);
+		auto dst_size = std::min(dst_end - dst, MAX_AVAIL);
+
+		stream_.next_in   = reinterpret_cast<std::uint8_t const*>(src);
+		stream_.avail_in  = static_cast<std::uint32_t>(src_size);
+		stream_.next_out  = reinterpret_cast<std::uint8_t*>(dst);
+		stream_.avail_out = static_cast<std::uint32_t>(dst_size);
+
+		auto code = zng_inflate(&stream_, Z_NO_FLUSH);
+		if (Z_OK != code && Z_STREAM_END != code && Z_BUF_ERROR != code) {
+			throw std::runtime_error(std::string("ufo::CompressorZLIB: ") +
+			                         (stream_.msg ? stream_.msg : "decompression failed"));
+		}
+
+		src += src_size - stream_.avail_in;
+		dst += dst_size - stream_.avail_out;
+		return Z_STREAM_END == code;
+	}
+
+ private:
+	zng_stream stream_{};
+};
+}  // namespace
+
 CompressorZLIB::CompressorZLIB() noexcept : compression_level(Z_DEFAULT_COMPRESSION) {}
 
 CompressorZLIB::size_type CompressorZLIB::maxSizeImpl() const
@@ -69,12 +159,13 @@ CompressorZLIB::size_type CompressorZLIB::compress(std::byte const* src, std::by
 	auto        code = zng_compress2(reinterpret_cast<std::uint8_t*>(dst), &dst_length,
 	                                 reinterpret_cast<std::uint8_t const*>(src), src_size,
 	                                 compression_level);
-	if (Z_OK == code) {
-		return dst_length;
+	switch (code) {
+		case Z_OK: return dst_length;
+		case Z_MEM_ERROR: throw std::bad_alloc();
+		// Z_BUF_ERROR: `dst_cap` is too small, Z_STREAM_ERROR: invalid level. 0 signals the
+		// failure, the caller reports it.
+		default: return 0;
 	}
-
-	// TODO: Handle errors
-	return 0;
 }
 
 CompressorZLIB::size_type CompressorZLIB::decompress(std::byte const* src, std::byte* dst,
@@ -85,11 +176,33 @@ CompressorZLIB::size_type CompressorZLIB::decompress(std::byte const* src, std::
 	std::size_t src_length = src_size;
 	auto        code = zng_uncompress2(reinterpret_cast<std::uint8_t*>(dst), &dst_length,
 	                                   reinterpret_cast<std::uint8_t const*>(src), &src_length);
-	if (Z_OK == code) {
-		return dst_length;
+	switch (code) {
+		case Z_OK: return dst_length;
+		case Z_MEM_ERROR: throw std::bad_alloc();
+		// Z_DATA_ERROR: corrupt input, Z_BUF_ERROR: truncated input or `dst_cap` too
+		// small. 0 signals the failure, the caller reports it.
+		default: return 0;
 	}
+}
 
-	// TODO: Handle errors
-	return 0;
+std::unique_ptr<Compressor::Stream> CompressorZLIB::compressStream() const
+{
+	return std::make_unique<ZLIBCompressStream>(compression_level);
 }
+
+std::unique_ptr<Compressor::Stream> CompressorZLIB::decompressStream() const
+{
+	return std::make_unique<ZLIBDecompressStream>();
+}
+
+int CompressorZLIB::numLevels() const { return Z_BEST_COMPRESSION - Z_BEST_SPEED + 1; }
+
+int CompressorZLIB::level() const
+{
+	// Z_DEFAULT_COMPRESSION is level 6
+	auto value = Z_DEFAULT_COMPRESSION == compression_level ? 6 : compression_level;
+	return std::clamp(value, Z_BEST_SPEED, Z_BEST_COMPRESSION) - Z_BEST_SPEED;
+}
+
+void CompressorZLIB::setLevel(int level) { compression_level = Z_BEST_SPEED + level; }
 }  // namespace ufo
\ No newline at end of file
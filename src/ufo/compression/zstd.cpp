@@ -43,10 +43,248 @@
 #include <ufo/compression/zstd.hpp>
 
 // ZSTD
+#include <zdict.h>
 #include <zstd.h>
 
+// STL
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 namespace ufo
 {
+namespace
+{
+void check(std::size_t code)
+{
+	if (ZSTD_isError(code)) {
+		throw std::runtime_error(std::string("ufo::CompressorZSTD: ") +
+		                         ZSTD_getErrorName(code));
+	}
+}
+
+struct CCtxDeleter {
+	void operator()(ZSTD_CCtx* ctx) const { ZSTD_freeCCtx(ctx); }
+};
+
+struct DCtxDeleter {
+	void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+};
+
+struct CDictDeleter {
+	void operator()(ZSTD_CDict* dict) const { ZSTD_freeCDict(dict); }
+};
+
+struct DDictDeleter {
+	void operator()(ZSTD_DDict* dict) const { ZSTD_freeDDict(dict); }
+};
+
+// One-shot calls reuse a context per thread instead of allocating a new one (several
+// MB at high levels) every time, which keeps the const calls thread-safe.
+ZSTD_CCtx* threadCCtx()
+{
+	thread_local std::unique_ptr<ZSTD_CCtx, CCtxDeleter> ctx(ZSTD_createCCtx());
+	return ctx.get();
+}
+
+ZSTD_DCtx* threadDCtx()
+{
+	thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> ctx(ZSTD_createDCtx());
+	return ctx.get();
+}
+
+/*
+ * Contexts of the streams of the native format, handed back to the thread a stream is
+ * destroyed on and taken again by its next streams. A chain may hold several streams at
+ * the same time, so each thread keeps as many as it has needed at once.
+ */
+template <class Ctx, class Deleter>
+std::vector<std::unique_ptr<Ctx, Deleter>>& releasedContexts()
+{
+	thread_local std::vector<std::unique_ptr<Ctx, Deleter>> list;
+	return list;
+}
+
+template <class Ctx, class Deleter, class Create>
+std::unique_ptr<Ctx, Deleter> takeContext(Create create)
+{
+	auto& list = releasedContexts<Ctx, Deleter>();
+	if (list.empty()) {
+		std::unique_ptr<Ctx, Deleter> ctx(create());
+		if (!ctx) {
+			throw std::bad_alloc();
+		}
+		return ctx;
+	}
+	auto ctx = std::move(list.back());
+	list.pop_back();
+	return ctx;
+}
+
+template <class Ctx, class Deleter>
+void releaseContext(std::unique_ptr<Ctx, Deleter> ctx) noexcept
+{
+	try {
+		releasedContexts<Ctx, Deleter>().push_back(std::move(ctx));
+	} catch (...) {
+		// Not kept then
+	}
+}
+
+class ZSTDCompressStream final : public Compressor::Stream
+{
+ public:
+	ZSTDCompressStream(int compression_level, ZSTD_CDict const* dict)
+	    : ctx_(takeContext<ZSTD_CCtx, CCtxDeleter>(ZSTD_createCCtx))
+	{
+		// A reused context may have been left in the middle of a frame
+		check(ZSTD_CCtx_reset(ctx_.get(), ZSTD_reset_session_and_parameters));
+		check(ZSTD_CCtx_setParameter(ctx_.get(), ZSTD_c_compressionLevel, compression_level));
+		if (dict) {
+			check(ZSTD_CCtx_refCDict(ctx_.get(), dict));
+		}
+	}
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool finish) override
+	{
+		ZSTD_inBuffer  in{src, static_cast<std::size_t>(src_end - src), 0};
+		ZSTD_outBuffer out{dst, static_cast<std::size_t>(dst_end - dst), 0};
+
+		auto left =
+		    ZSTD_compressStream2(ctx_.get(), &out, &in, finish ? ZSTD_e_end : ZSTD_e_continue);
+		check(left);
+
+		src += in.pos;
+		dst += out.pos;
+		return finish && 0 == left;
+	}
+
+	~ZSTDCompressStream() override { releaseContext(std::move(ctx_)); }
+
+ private:
+	std::unique_ptr<ZSTD_CCtx, CCtxDeleter> ctx_;
+};
+
+class ZSTDDecompressStream final : public Compressor::Stream
+{
+ public:
+	explicit ZSTDDecompressStream(ZSTD_DDict const* dict)
+	    : ctx_(takeContext<ZSTD_DCtx, DCtxDeleter>(ZSTD_createDCtx))
+	{
+		check(ZSTD_DCtx_reset(ctx_.get(), ZSTD_reset_session_and_parameters));
+		if (dict) {
+			check(ZSTD_DCtx_refDDict(ctx_.get(), dict));
+		}
+	}
+
+	bool process(std::byte const*& src, std::byte const* src_end, std::byte*& dst,
+	             std::byte* dst_end, bool /* finish */) override
+	{
+		ZSTD_inBuffer  in{src, static_cast<std::size_t>(src_end - src), 0};
+		ZSTD_outBuffer out{dst, static_cast<std::size_t>(dst_end - dst), 0};
+
+		auto hint = ZSTD_decompressStream(ctx_.get(), &out, &in);
+		check(hint);
+
+		src += in.pos;
+		dst += out.pos;
+		// 0 means the frame has been fully decoded and flushed
+		return 0 == hint;
+	}
+
+	~ZSTDDecompressStream() override { releaseContext(std::move(ctx_)); }
+
+ private:
+	std::unique_ptr<ZSTD_DCtx, DCtxDeleter> ctx_;
+};
+/*
+ * Levels of the adaptive mode: the fast levels down to -FASTEST_LEVEL followed by the
+ * regular levels, skipping 0 (which means the default level).
+ */
+constexpr int FASTEST_LEVEL = 7;
+}  // namespace
+
+struct ZSTDDictionary::Impl {
+	std::vector<std::byte>                    data;
+	std::uint32_t                             id;
+	std::unique_ptr<ZSTD_DDict, DDictDeleter> ddict;
+
+	// Digested dictionaries of the levels the adaptive mode uses, found without locking
+	std::vector<std::atomic<ZSTD_CDict const*>> levels;
+
+	std::mutex                                               mutex;
+	std::map<int, std::unique_ptr<ZSTD_CDict, CDictDeleter>> cdicts;
+
+	Impl() : levels(FASTEST_LEVEL + ZSTD_maxCLevel() + 1) {}
+
+	// Digested for `level` on first use, the result lives as long as the dictionary
+	ZSTD_CDict const* cdict(int level)
+	{
+		auto i      = static_cast<std::size_t>(level + FASTEST_LEVEL);
+		auto cached = -FASTEST_LEVEL <= level && levels.size() > i;
+		if (cached) {
+			if (auto dict = levels[i].load(std::memory_order_acquire)) {
+				return dict;
+			}
+		}
+
+		std::lock_guard lock(mutex);
+		auto&           dict = cdicts[level];
+		if (!dict) {
+			dict.reset(ZSTD_createCDict(data.data(), data.size(), level));
+		}
+		if (cached) {
+			levels[i].store(dict.get(), std::memory_order_release);
+		}
+		return dict.get();
+	}
+};
+
+ZSTDDictionary::ZSTDDictionary(std::vector<std::byte> data)
+    : impl_(std::make_shared<Impl>())
+{
+	impl_->id = ZDICT_getDictID(data.data(), data.size());
+	if (0 == impl_->id) {
+		throw std::invalid_argument("ufo::ZSTDDictionary: not a zstd dictionary");
+	}
+	impl_->ddict.reset(ZSTD_createDDict(data.data(), data.size()));
+	if (!impl_->ddict) {
+		throw std::bad_alloc();
+	}
+	impl_->data = std::move(data);
+}
+
+ZSTDDictionary ZSTDDictionary::train(std::byte const*                samples,
+                                     std::vector<std::size_t> const& sample_sizes,
+                                     std::size_t                     capacity)
+{
+	std::vector<std::byte> data(capacity);
+	auto size = ZDICT_trainFromBuffer(data.data(), data.size(), samples, sample_sizes.data(),
+	                                  static_cast<unsigned>(sample_sizes.size()));
+	if (ZDICT_isError(size)) {
+		throw std::runtime_error(std::string("ufo::ZSTDDictionary: ") +
+		                         ZDICT_getErrorName(size));
+	}
+	data.resize(size);
+	return ZSTDDictionary(std::move(data));
+}
+
+std::uint32_t ZSTDDictionary::id() const noexcept { return impl_ ? impl_->id : 0; }
+
+std::vector<std::byte> const& ZSTDDictionary::data() const
+{
+	static std::vector<std::byte> const empty;
+	return impl_ ? impl_->data : empty;
+}
+
 CompressorZSTD::CompressorZSTD() noexcept : compression_level(ZSTD_defaultCLevel()) {}
 
 CompressorZSTD::size_type CompressorZSTD::maxSizeImpl() const
@@ -67,14 +305,97 @@ CompressorZSTD::size_type CompressorZSTD::compress(std::byte const* src, std::by
 {
 	assert(ZSTD_minCLevel() <= compression_level);
 	assert(ZSTD_maxCLevel() >= compression_level);
-	return static_cast<size_type>(
-	    ZSTD_compress(dst, dst_cap, src, src_size, compression_level));
+	auto ctx = threadCCtx();
+	if (!ctx) {
+		return 0;
+	}
+	std::size_t size;
+	if (dictionary) {
+		auto dict = dictionary.impl_->cdict(compression_level);
+		if (!dict) {
+			return 0;
+		}
+		size = ZSTD_compress_usingCDict(ctx, dst, dst_cap, src, src_size, dict);
+	} else {
+		// Only uses `compression_level`, parameters left over from earlier calls are ignored
+		size = ZSTD_compressCCtx(ctx, dst, dst_cap, src, src_size, compression_level);
+	}
+	return ZSTD_isError(size) ? 0 : static_cast<size_type>(size);
 }
 
 CompressorZSTD::size_type CompressorZSTD::decompress(std::byte const* src, std::byte* dst,
                                                      size_type src_size,
                                                      size_type dst_cap) const
 {
-	return static_cast<size_type>(ZSTD_decompress(dst, dst_cap, src, src_size));
+	auto ctx = threadDCtx();
+	if (!ctx) {
+		return 0;
+	}
+	auto size = dictionary ? ZSTD_decompress_usingDDict(ctx, dst, dst_cap, src, src_size,
+	                                                    dictionary.impl_->ddict.get())
+	                       : ZSTD_decompressDCtx(ctx, dst, dst_cap, src, src_size);
+	return ZSTD_isError(size) ? 0 : static_cast<size_type>(size);
+}
+
+std::unique_ptr<Compressor::Stream> CompressorZSTD::compressStream() const
+{
+	ZSTD_CDict const* dict{};
+	if (dictionary) {
+		dict = dictionary.impl_->cdict(compression_level);
+		if (!dict) {
+			throw std::bad_alloc();
+		}
+	}
+	return std::make_unique<ZSTDCompressStream>(compression_level, dict);
+}
+
+std::unique_ptr<Compressor::Stream> CompressorZSTD::decompressStream() const
+{
+	return std::make_unique<ZSTDDecompressStream>(
+	    dictionary ? dictionary.impl_->ddict.get() : nullptr);
+}
+
+int CompressorZSTD::numLevels() const { return FASTEST_LEVEL + ZSTD_maxCLevel(); }
+
+int CompressorZSTD::level() const
+{
+	auto value = 0 == compression_level ? ZSTD_defaultCLevel() : compression_level;
+	value      = std::clamp(value, -FASTEST_LEVEL, ZSTD_maxCLevel());
+	return 0 > value ? value + FASTEST_LEVEL : value + FASTEST_LEVEL - 1;
+}
+
+void CompressorZSTD::setLevel(int level)
+{
+	compression_level =
+	    FASTEST_LEVEL > level ? level - FASTEST_LEVEL : level - FASTEST_LEVEL + 1;
+}
+
+std::vector<std::byte> CompressorZSTD::parameters() const
+{
+	if (!dictionary) {
+		return {};
+	}
+	std::vector<std::byte> parameters(sizeof(std::uint32_t));
+	auto                   id = dictionary.id();
+	std::memcpy(parameters.data(), &id, sizeof(id));
+	return parameters;
+}
+
+void CompressorZSTD::setParameters(std::byte const* data, size_type size)
+{
+	if (0 == size) {
+		dictionary = {};
+		return;
+	}
+	if (sizeof(std::uint32_t) != size) {
+		throw std::runtime_error("ufo::CompressorZSTD: invalid parameters");
+	}
+
+	std::uint32_t id;
+	std::memcpy(&id, data, sizeof(id));
+	if (dictionary.id() != id) {
+		throw std::runtime_error("ufo::CompressorZSTD: dictionary " + std::to_string(id) +
+		                         " required");
+	}
 }
 }  // namespace ufo
\ No newline at end of file
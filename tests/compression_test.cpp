@@ -1,28 +1,212 @@
 // UFO
 #include <ufo/compression/compression.hpp>
+#include <ufo/compression/thread_pool.hpp>
 
 // Catch2
 #include <catch2/catch_test_macros.hpp>
 
 // STL
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
 
 using namespace ufo;
 
-TEST_CASE("NONE Compression") { CompressorNone compressor; }
+std::string testData(std::size_t size)
+{
+	// Compressible, but not trivially so
+	std::mt19937                    gen(42);
+	std::uniform_int_distribution<> dist(0, 15);
+	std::string                     data(size, '\0');
+	for (std::size_t i{}; size > i; ++i) {
+		data[i] = static_cast<char>(0 == i % 7 ? dist(gen) : i % 251);
+	}
+	return data;
+}
+
+std::string roundTrip(Compressor const& compressor, std::string const& data)
+{
+	std::stringstream in(data);
+	std::stringstream compressed;
+	auto compressed_size = compressor.compress(in, compressed, data.size());
+	REQUIRE(compressed.str().size() == compressed_size);
+	REQUIRE(compressor.compressBound(data.size()) >= compressed_size);
+
+	std::stringstream out;
+	REQUIRE(data.size() == Compressor::decompress(compressed, out));
+	return out.str();
+}
+
+std::string frame(Compressor const& compressor, std::string const& data)
+{
+	std::stringstream in(data);
+	std::stringstream out;
+	compressor.compress(in, out, data.size());
+	return out.str();
+}
+
+// Cancels `token` once the first read from it is done
+struct CancellingBuf : std::stringbuf {
+	using std::stringbuf::stringbuf;
+
+	CancellationToken token;
+
+	std::streamsize xsgetn(char* s, std::streamsize n) override
+	{
+		auto read = std::stringbuf::xsgetn(s, n);
+		token.cancel();
+		return read;
+	}
+};
+
+// Records the level the adaptive mode last compressed a block at, shared by its copies
+struct LevelRecorder : CompressorZSTD {
+	std::shared_ptr<std::atomic<int>> last = std::make_shared<std::atomic<int>>(-1);
+
+	[[nodiscard]] int levels() const { return numLevels(); }
+
+	[[nodiscard]] LevelRecorder* clone() const override { return new LevelRecorder(*this); }
+
+ protected:
+	size_type compress(std::byte const* src, std::byte* dst, size_type src_size,
+	                   size_type dst_cap) const override
+	{
+		*last = level();
+		return CompressorZSTD::compress(src, dst, src_size, dst_cap);
+	}
+};
+
+std::string nativeRoundTrip(Compressor const& compressor, std::string const& data)
+{
+	std::stringstream in(data);
+	std::stringstream compressed;
+	auto compressed_size = compressor.compress(in, compressed, data.size(), true);
+	REQUIRE(compressed.str().size() == compressed_size);
+
+	std::stringstream out;
+	REQUIRE(data.size() == compressor.decompress(compressed, out, true));
+	return out.str();
+}
+
+TEST_CASE("NONE Compression")
+{
+	CompressorNone compressor;
+	compressor.block_size = 1000;
+
+	auto data = testData(12345);
+	REQUIRE(data == roundTrip(compressor, data));
+	REQUIRE(roundTrip(compressor, "").empty());
+	REQUIRE(data == nativeRoundTrip(compressor, data));
+}
 
 TEST_CASE("LZ4 Compression")
 {
 	CompressorLZ4 compressor;
 	// compressor.next(CompressorZSTD()).next(CompressorZLIB()).next(CompressorLZF());
 
-	for (Compressor* it = &compressor; it; it = &it->next()) {
+	for (Compressor* it : compressor.chain()) {
 		std::cout << enumToString(it->type()) << std::endl;
 	}
 
 	std::cout << compressor.size() << std::endl;
 
+	SECTION("Round trip")
+	{
+		compressor.block_size = 10000;
+		auto data             = testData(100000);
+		REQUIRE(data == roundTrip(compressor, data));
+		REQUIRE(data == nativeRoundTrip(compressor, data));
+
+		// Fast and HC calls alternate on the same per-thread states
+		CompressorLZ4 hc(1, 9);
+		hc.block_size = 10000;
+		for (int i{}; 3 > i; ++i) {
+			REQUIRE(data == roundTrip(hc, data));
+			REQUIRE(data == roundTrip(compressor, data));
+		}
+	}
+
+	SECTION("Dictionary")
+	{
+		auto data = testData(100000);
+		auto dict = testData(70000);
+
+		CompressorLZ4 with(1, 0, LZ4Dictionary(std::vector<std::byte>(
+		                             reinterpret_cast<std::byte const*>(dict.data()),
+		                             reinterpret_cast<std::byte const*>(dict.data()) +
+		                                 dict.size())));
+		REQUIRE(0 != with.dictionary.id());
+		REQUIRE(64 * 1024 == with.dictionary.data().size());
+
+		for (int level : {0, 2, 9, 12}) {
+			with.compression_level = level;
+			with.block_size        = 1000;
+
+			std::stringstream in(data);
+			std::stringstream compressed;
+			with.compress(in, compressed, data.size());
+
+			std::stringstream out;
+			REQUIRE_THROWS(Compressor::decompress(compressed, out));
+			compressed.seekg(0);
+			REQUIRE(data.size() == with.decompress(compressed, out, false));
+			REQUIRE(data == out.str());
+
+			REQUIRE(data == nativeRoundTrip(with, data));
+		}
+	}
+
+	SECTION("Messages")
+	{
+		// Small messages that mostly repeat the previous one, and a few large ones
+		std::vector<std::string> messages;
+		auto                     base = testData(300);
+		for (int i{}; 1000 > i; ++i) {
+			base[i % base.size()] = static_cast<char>(i);
+			messages.push_back(0 == i % 300 ? testData(200000) : base);
+		}
+
+		LZ4MessageEncoder encoder;
+		LZ4MessageDecoder decoder;
+		for (int round{}; 2 > round; ++round) {
+			std::size_t total{};
+			for (auto const& m : messages) {
+				auto src = reinterpret_cast<std::byte const*>(m.data());
+				std::vector<std::byte> compressed(LZ4MessageEncoder::compressBound(m.size()));
+				auto compressed_size =
+				    encoder.compress(src, m.size(), compressed.data(), compressed.size());
+				if (300 == m.size()) {
+					total += compressed_size;
+				}
+
+				std::string out(m.size(), '\0');
+				REQUIRE(m.size() == decoder.decompress(compressed.data(), compressed_size,
+				                                       reinterpret_cast<std::byte*>(out.data()),
+				                                       out.size()));
+				REQUIRE(m == out);
+			}
+			// Far smaller than compressing each message on its own
+			REQUIRE(total < 997 * 100);
+
+			encoder.reset();
+			decoder.reset();
+		}
+	}
+
 	SECTION("Compress")
 	{
 		std::ifstream in(std::filesystem::path("/home/dduberg/Desktop/UFOMap.zip"),
@@ -41,8 +225,6 @@ TEST_CASE("LZ4 Compression")
 
 		in.close();
 		out.close();
-
-		compressor.compress("/home/dduberg/ufo/ufotime", "");
 	}
 
 	SECTION("Decompress")
@@ -57,8 +239,894 @@ TEST_CASE("LZ4 Compression")
 	}
 }
 
-TEST_CASE("ZSTD Compression") { CompressorZSTD compressor; }
+TEST_CASE("ZSTD Compression")
+{
+	CompressorZSTD compressor;
+
+	auto data = testData(100000);
+	REQUIRE(data == roundTrip(compressor, data));
+
+	// The per-thread context must pick up the level of each call
+	auto compressedSize = [&data](Compressor const& compressor) {
+		std::stringstream in(data);
+		std::stringstream out;
+		return compressor.compress(in, out, data.size());
+	};
+	CompressorZSTD fast(1);
+	CompressorZSTD strong(19);
+	auto           fast_size   = compressedSize(fast);
+	auto           strong_size = compressedSize(strong);
+	REQUIRE(fast_size != strong_size);
+	REQUIRE(fast_size == compressedSize(fast));
+	REQUIRE(strong_size == compressedSize(strong));
+	REQUIRE(data == roundTrip(strong, data));
+
+	compressor.block_size = 1000;
+	REQUIRE(data == nativeRoundTrip(compressor, data));
+	REQUIRE(nativeRoundTrip(compressor, "").empty());
+
+	SECTION("Dictionary")
+	{
+		auto                     samples = testData(200 * 1000);
+		std::vector<std::size_t> sample_sizes(200, 1000);
+		auto dictionary = ZSTDDictionary::train(
+		    reinterpret_cast<std::byte const*>(samples.data()), sample_sizes, 16 * 1024);
+		REQUIRE(0 != dictionary.id());
+
+		CompressorZSTD with(3, dictionary);
+		with.block_size = 1000;
+		compressor.compression_level = 3;
+		REQUIRE(compressedSize(with) < compressedSize(compressor));
+
+		std::stringstream in(data);
+		std::stringstream compressed;
+		with.compress(in, compressed, data.size());
+
+		// The dictionary is not stored in the data, only its id
+		std::stringstream out;
+		REQUIRE_THROWS(Compressor::decompress(compressed, out));
+		compressed.seekg(0);
+		REQUIRE(data.size() == with.decompress(compressed, out, false));
+		REQUIRE(data == out.str());
+
+		REQUIRE(data == nativeRoundTrip(with, data));
+	}
+}
+
+TEST_CASE("LZF Compression")
+{
+	CompressorLZF compressor;
+
+	auto data = testData(100000);
+	REQUIRE(data == roundTrip(compressor, data));
 
-TEST_CASE("LZF Compression") { CompressorLZF compressor; }
+	// Hash table sizes share, and grow, the per-thread table; out of range is clamped
+	for (int hash_log : {12, CompressorLZF::MAX_HASH_LOG + 1, 0, 16}) {
+		CompressorLZF other(hash_log);
+		REQUIRE(data == roundTrip(other, data));
+	}
 
-TEST_CASE("ZLIB Compression") { CompressorZLIB compressor; }
\ No newline at end of file
+	compressor.block_size = 1000;
+	REQUIRE(data == nativeRoundTrip(compressor, data));
+	REQUIRE(nativeRoundTrip(compressor, "").empty());
+}
+
+TEST_CASE("ZLIB Compression")
+{
+	CompressorZLIB compressor;
+
+	auto data = testData(100000);
+	REQUIRE(data == roundTrip(compressor, data));
+
+	compressor.block_size = 1000;
+	REQUIRE(data == nativeRoundTrip(compressor, data));
+	REQUIRE(nativeRoundTrip(compressor, "").empty());
+}
+
+TEST_CASE("SHUFFLE Compression")
+{
+	// Slowly varying floats, where mostly the low bytes change
+	std::string data(4 * 25000 + 3, '\0');
+	for (std::size_t i{}; 25000 > i; ++i) {
+		float f = 1000.0f + 0.01f * static_cast<float>(i);
+		std::memcpy(data.data() + 4 * i, &f, sizeof(f));
+	}
+
+	for (std::size_t element_size : {1, 2, 3, 4, 8, 16, 17}) {
+		CompressorSHUFFLE    shuffle(element_size);
+		CompressorBITSHUFFLE bitshuffle(element_size);
+		// Around the widths of the SIMD kernels, with and without a partial element
+		for (std::size_t size : {0, 7, 100, 1000, 1027, 4000}) {
+			auto part = data.substr(0, size);
+			REQUIRE(part == roundTrip(shuffle, part));
+			REQUIRE(part == roundTrip(bitshuffle, part));
+		}
+
+		// The frame of a single filter holds its output as is
+		auto        part = data.substr(0, 1000 + element_size / 2);
+		auto        num  = part.size() / element_size;
+		std::string shuffled(part);
+		std::string bitshuffled(part);
+		for (std::size_t i{}; num > i; ++i) {
+			for (std::size_t j{}; element_size > j; ++j) {
+				shuffled[j * num + i] = part[i * element_size + j];
+			}
+		}
+		auto bit_num = num / 8 * 8;
+		std::fill_n(bitshuffled.begin(), bit_num * element_size, '\0');
+		for (std::size_t i{}; bit_num > i; ++i) {
+			for (std::size_t b{}; 8 * element_size > b; ++b) {
+				auto bit = (part[i * element_size + b / 8] >> (b % 8)) & 1;
+				bitshuffled[(b * bit_num + i) / 8] |= static_cast<char>(bit << (i % 8));
+			}
+		}
+		REQUIRE(std::string::npos != frame(shuffle, part).find(shuffled));
+		REQUIRE(std::string::npos != frame(bitshuffle, part).find(bitshuffled));
+	}
+
+	// In front of a compressor
+	CompressorLZ4        lz4;
+	CompressorSHUFFLE    shuffle;
+	CompressorBITSHUFFLE bitshuffle;
+	shuffle.next(lz4);
+	bitshuffle.next(lz4);
+	REQUIRE(frame(shuffle, data).size() < frame(lz4, data).size());
+	REQUIRE(frame(bitshuffle, data).size() < frame(lz4, data).size());
+	REQUIRE(data == roundTrip(shuffle, data));
+	REQUIRE(data == roundTrip(bitshuffle, data));
+
+	shuffle.block_size = 1000;
+	REQUIRE(data == nativeRoundTrip(shuffle, data));
+}
+
+TEST_CASE("DELTA Compression")
+{
+	// Increasing timestamps and slowly varying floats
+	std::mt19937                    gen(42);
+	std::uniform_int_distribution<> step(1, 100);
+	std::string                     timestamps(8 * 20000, '\0');
+	std::string                     floats(4 * 20000, '\0');
+	std::uint64_t                   t = 1700000000000000000ull;
+	for (std::size_t i{}; 20000 > i; ++i) {
+		t += step(gen);
+		float f = std::sin(0.001f * static_cast<float>(i));
+		std::memcpy(timestamps.data() + 8 * i, &t, sizeof(t));
+		std::memcpy(floats.data() + 4 * i, &f, sizeof(f));
+	}
+
+	auto data = testData(10000);
+	for (std::size_t element_size : {1, 2, 4, 8}) {
+		CompressorDELTA delta(element_size);
+		CompressorXOR   x(element_size);
+		// Around the SIMD width, with and without a partial element
+		for (std::size_t size : {0, 1, 7, 17, 100, 1003, 10000}) {
+			auto part = data.substr(0, size);
+			REQUIRE(part == roundTrip(delta, part));
+			REQUIRE(part == roundTrip(x, part));
+		}
+		REQUIRE(timestamps == roundTrip(delta, timestamps));
+		REQUIRE(floats == roundTrip(x, floats));
+	}
+
+	// Differences wrap around
+	std::string expected(4 * 3, '\0');
+	std::string values(4 * 3, '\0');
+	for (auto [i, value, difference] : {std::tuple{0, 5u, 5u}, std::tuple{1, 3u, 0u - 2u},
+	                                     std::tuple{2, 0xFFFFFFFFu, 0xFFFFFFFCu}}) {
+		std::memcpy(values.data() + 4 * i, &value, 4);
+		std::memcpy(expected.data() + 4 * i, &difference, 4);
+	}
+	REQUIRE(std::string::npos != frame(CompressorDELTA(4), values).find(expected));
+
+	CompressorDELTA invalid(3);
+	REQUIRE_THROWS(roundTrip(invalid, data));
+	REQUIRE_THROWS(roundTrip(CompressorDELTA(0), data));
+	REQUIRE_THROWS(roundTrip(CompressorXOR(0), data));
+
+	// In front of a compressor
+	CompressorLZ4   lz4;
+	CompressorDELTA delta(8);
+	CompressorXOR   x(4);
+	delta.next(lz4);
+	x.next(lz4);
+	REQUIRE(frame(delta, timestamps).size() < frame(lz4, timestamps).size());
+	REQUIRE(frame(x, floats).size() < frame(lz4, floats).size());
+	REQUIRE(timestamps == roundTrip(delta, timestamps));
+	REQUIRE(floats == roundTrip(x, floats));
+
+	delta.block_size = 1000;
+	REQUIRE(timestamps == nativeRoundTrip(delta, timestamps));
+}
+
+TEST_CASE("QUANTIZE Compression")
+{
+	// Occupancy-like probabilities, with values outside the range and a partial float
+	std::vector<float> values(10003);
+	for (std::size_t i{}; values.size() > i; ++i) {
+		values[i] = 0.5f + 0.6f * std::sin(0.01f * static_cast<float>(i));
+	}
+	values[7] = std::numeric_limits<float>::quiet_NaN();
+	std::string data(reinterpret_cast<char const*>(values.data()),
+	                 values.size() * sizeof(float));
+	data += "ab";
+
+	for (int bits : {8, 16}) {
+		CompressorQUANTIZE compressor(0.0f, 1.0f, bits);
+		auto               out = roundTrip(compressor, data);
+		REQUIRE(data.size() == out.size());
+		REQUIRE("ab" == out.substr(out.size() - 2));
+
+		std::vector<float> decompressed(values.size());
+		std::memcpy(decompressed.data(), out.data(), decompressed.size() * sizeof(float));
+		float error{};
+		for (std::size_t i{}; values.size() > i; ++i) {
+			auto expected = 7 == i ? 0.0f : std::clamp(values[i], 0.0f, 1.0f);
+			error         = std::max(error, std::abs(expected - decompressed[i]));
+		}
+		REQUIRE(compressor.maxError() * 1.001f >= error);
+
+		// A quarter or half of the size, plus the frame
+		auto size = frame(compressor, data).size();
+		REQUIRE(values.size() * bits / 8 < size);
+		REQUIRE(values.size() * bits / 8 + 100 > size);
+
+		// Quantized values restore exactly
+		REQUIRE(out == roundTrip(compressor, out));
+	}
+
+	REQUIRE(8 == CompressorQUANTIZE::withErrorBound(-1.0f, 1.0f, 0.01f).bits);
+	REQUIRE(16 == CompressorQUANTIZE::withErrorBound(-1.0f, 1.0f, 0.001f).bits);
+	REQUIRE_THROWS(CompressorQUANTIZE::withErrorBound(-1.0f, 1.0f, 1e-6f));
+
+	// In front of a compressor, decompressed with the parameters from the frame
+	auto compressor = CompressorQUANTIZE::withErrorBound(0.0f, 1.0f, 0.01f);
+	compressor.next(CompressorLZ4());
+	REQUIRE(roundTrip(compressor, data).size() == data.size());
+	compressor.block_size = 1000;
+	REQUIRE(nativeRoundTrip(compressor, data) == roundTrip(compressor, data));
+}
+
+TEST_CASE("RLE Compression")
+{
+	// Leaf-like values, long runs of a few values with runs of every length in between
+	std::mt19937                    gen(42);
+	std::uniform_int_distribution<> value(0, 3);
+	std::uniform_int_distribution<> length(1, 40);
+	std::vector<std::uint32_t>      leaves;
+	while (100000 > leaves.size()) {
+		auto v = static_cast<std::uint32_t>(value(gen));
+		leaves.insert(leaves.end(), 0 == v ? 5000 : length(gen), v);
+	}
+	std::string runs(reinterpret_cast<char const*>(leaves.data()),
+	                 leaves.size() * sizeof(std::uint32_t));
+
+	auto data = testData(10000);
+	for (std::size_t element_size : {1, 2, 3, 4, 8, 16, 255}) {
+		CompressorRLE rle(element_size);
+		// Around the SIMD width, with and without a partial element
+		for (std::size_t size : {0, 1, 7, 17, 33, 100, 1003, 10000}) {
+			auto part = data.substr(0, size);
+			REQUIRE(part == roundTrip(rle, part));
+			part = runs.substr(0, size);
+			REQUIRE(part == roundTrip(rle, part));
+		}
+		REQUIRE(runs == roundTrip(rle, runs));
+		REQUIRE(runs + "ab" == roundTrip(rle, runs + "ab"));
+	}
+
+	// A single run is a count and an element, one byte more than a single element
+	std::string uniform(4 * 1000, '\x7F');
+	REQUIRE(frame(CompressorRLE(4), uniform.substr(0, 4)).size() + 1 ==
+	        frame(CompressorRLE(4), uniform).size());
+
+	CompressorRLE invalid(0);
+	REQUIRE_THROWS(roundTrip(invalid, data));
+
+	// In front of a compressor
+	CompressorLZ4 lz4;
+	CompressorRLE rle(4);
+	rle.next(lz4);
+	REQUIRE(frame(rle, runs).size() < frame(lz4, runs).size());
+	REQUIRE(runs == roundTrip(rle, runs));
+
+	rle.block_size = 1000;
+	REQUIRE(runs == nativeRoundTrip(rle, runs));
+}
+
+TEST_CASE("Compression Chain")
+{
+	CompressorLZ4 compressor;
+	compressor.block_size = 4096;
+	compressor.next(CompressorZSTD()).next(CompressorLZF());
+
+	REQUIRE(3 == compressor.size());
+
+	auto data = testData(100000);
+	REQUIRE(data == roundTrip(compressor, data));
+
+	SECTION("Parallel")
+	{
+		std::stringstream in(data);
+		std::stringstream serial;
+		compressor.compress(in, serial, data.size());
+
+		compressor.num_threads = 4;
+
+		in.str(data);
+		std::stringstream parallel;
+		compressor.compress(in, parallel, data.size());
+
+		REQUIRE(serial.str() == parallel.str());
+		REQUIRE(data == roundTrip(compressor, data));
+
+		std::stringstream out;
+		REQUIRE(data.size() == compressor.decompress(parallel, out, false));
+		REQUIRE(data == out.str());
+
+		auto        str = parallel.str();
+		ReadBuffer  rb(reinterpret_cast<std::byte const*>(str.data()), str.size());
+		WriteBuffer wb;
+		REQUIRE(data.size() == compressor.decompress(rb, wb, false));
+		REQUIRE(0 == rb.readLeft());
+		REQUIRE(data.size() == wb.size());
+		REQUIRE(0 == std::memcmp(data.data(), wb.data(), data.size()));
+
+		// Frame followed by other data, the blocks have to be found without the index
+		str += "tail";
+		ReadBuffer  rb2(reinterpret_cast<std::byte const*>(str.data()), str.size());
+		WriteBuffer wb2;
+		REQUIRE(data.size() == compressor.decompress(rb2, wb2, false));
+		REQUIRE(4 == rb2.readLeft());
+		REQUIRE(0 == std::memcmp(data.data(), wb2.data(), data.size()));
+	}
+
+	SECTION("Pipeline")
+	{
+		std::stringstream in(data);
+		std::stringstream serial;
+		compressor.compress(in, serial, data.size());
+
+		compressor.pipeline = true;
+
+		in.str(data);
+		std::stringstream pipelined;
+		compressor.compress(in, pipelined, data.size());
+		REQUIRE(serial.str() == pipelined.str());
+
+		std::stringstream out;
+		REQUIRE(data.size() == compressor.decompress(pipelined, out, false));
+		REQUIRE(data == out.str());
+
+		ReadBuffer  rb(reinterpret_cast<std::byte const*>(data.data()), data.size());
+		WriteBuffer compressed;
+		compressor.compress(rb, compressed);
+		REQUIRE(serial.str().size() == compressed.size());
+		REQUIRE(0 == std::memcmp(serial.str().data(), compressed.data(), compressed.size()));
+
+		ReadBuffer  crb(compressed.data(), compressed.size());
+		WriteBuffer wb;
+		REQUIRE(data.size() == compressor.decompress(crb, wb, false));
+		REQUIRE(0 == std::memcmp(data.data(), wb.data(), data.size()));
+
+		// A stage failing partway, with later blocks still in the stages
+		auto corrupt = serial.str();
+		for (std::size_t i = corrupt.size() / 4; corrupt.size() / 2 > i; ++i) {
+			corrupt[i] = static_cast<char>(~corrupt[i]);
+		}
+		for (int i{}; 10 > i; ++i) {
+			std::stringstream cin(corrupt);
+			std::stringstream cout;
+			REQUIRE_THROWS(compressor.decompress(cin, cout, false));
+		}
+
+		// Cancelled partway, after reading the first block
+		for (int i{}; 10 > i; ++i) {
+			compressor.cancellation = CancellationToken::create();
+			CancellingBuf buf(data);
+			buf.token = compressor.cancellation;
+			std::istream      cin(&buf);
+			std::stringstream cout;
+			REQUIRE_THROWS_AS(compressor.compress(cin, cout, data.size()),
+			                  CompressionCancelled);
+		}
+	}
+
+	SECTION("Adaptive")
+	{
+		// Unreachable targets drive the levels to either end, which must still decode
+		for (double speed : {1e15, 1.0}) {
+			for (bool pipeline : {false, true}) {
+				compressor.target_speed = speed;
+				compressor.pipeline     = pipeline;
+				compressor.num_threads  = 2;
+				REQUIRE(data == roundTrip(compressor, data));
+			}
+		}
+
+		CompressorZSTD zstd;
+		zstd.block_size  = 1000;
+		zstd.time_budget = std::chrono::nanoseconds(1);
+		REQUIRE(data == roundTrip(zstd, data));
+
+		// One level per block towards the target, so 100 blocks reach either end
+		LevelRecorder recorder;
+		recorder.block_size = 1000;
+
+		auto lastLevel = [&]() {
+			*recorder.last = -1;
+			REQUIRE(data == roundTrip(recorder, data));
+			return recorder.last->load();
+		};
+
+		recorder.target_speed = 1e15;
+		REQUIRE(0 == lastLevel());
+		recorder.target_speed = 1.0;
+		REQUIRE(recorder.levels() - 1 == lastLevel());
+
+		recorder.target_speed = 0;
+		recorder.time_budget  = std::chrono::nanoseconds(1);
+		REQUIRE(0 == lastLevel());
+		recorder.time_budget = std::chrono::hours(24);
+		REQUIRE(recorder.levels() - 1 == lastLevel());
+	}
+
+	SECTION("Native")
+	{
+		REQUIRE(data == nativeRoundTrip(compressor, data));
+
+		// The stream ends with the data, what follows is left in the input
+		std::stringstream in(data);
+		std::stringstream compressed;
+		compressor.compress(in, compressed, data.size(), true);
+		compressed << "tail";
+
+		std::stringstream out;
+		REQUIRE(data.size() == compressor.decompress(compressed, out, true));
+		std::string tail;
+		compressed >> tail;
+		REQUIRE("tail" == tail);
+	}
+
+	SECTION("Buffer")
+	{
+		ReadBuffer rb(reinterpret_cast<std::byte const*>(data.data()), data.size());
+
+		for (bool native : {false, true}) {
+			for (std::size_t threads : {1, 4}) {
+				compressor.num_threads = threads;
+
+				std::stringstream in(data);
+				std::stringstream expected;
+				compressor.compress(in, expected, data.size(), native);
+
+				// Appended after what is already in the buffer
+				WriteBuffer compressed;
+				compressed.write("head", 4);
+				rb.setReadIndex(0);
+				REQUIRE(expected.str().size() == compressor.compress(rb, compressed, native));
+				REQUIRE(0 == rb.readLeft());
+				REQUIRE(4 + expected.str().size() == compressed.size());
+				REQUIRE(compressed.size() == compressed.writeIndex());
+				REQUIRE(0 == std::memcmp(expected.str().data(), compressed.data() + 4,
+				                         expected.str().size()));
+
+				compressed.write("tail", 4);
+				ReadBuffer crb(compressed.data(), compressed.size());
+				crb.skipRead(4);
+				WriteBuffer out;
+				REQUIRE(data.size() == compressor.decompress(crb, out, native));
+				REQUIRE(4 == crb.readLeft());
+				REQUIRE(data.size() == out.size());
+				REQUIRE(0 == std::memcmp(data.data(), out.data(), data.size()));
+			}
+		}
+	}
+
+	SECTION("Range")
+	{
+		std::stringstream in(data);
+		std::stringstream compressed;
+		compressor.compress(in, compressed, data.size());
+		auto frame = compressed.str();
+		auto bytes = reinterpret_cast<std::byte const*>(frame.data());
+
+		// Within a block, across blocks, whole blocks, and past the end
+		for (std::size_t num_threads : {1, 4}) {
+			compressor.num_threads = num_threads;
+			for (auto [offset, length] :
+			     {std::pair<std::size_t, std::size_t>{0, 10}, {100, 1000}, {4000, 200},
+			      {4096, 8192}, {5000, 50000}, {0, 100000}, {99990, 100}, {100000, 10}}) {
+				auto expected = data.substr(std::min(offset, data.size()), length);
+
+				std::stringstream fin(frame);
+				std::stringstream out;
+				REQUIRE(expected.size() == compressor.decompressRange(fin, out, offset, length));
+				REQUIRE(expected == out.str());
+
+				// Without the block index at the end
+				ReadBuffer  rb(bytes, frame.size() - 4);
+				WriteBuffer wb;
+				REQUIRE(expected.size() == compressor.decompressRange(rb, wb, offset, length));
+				REQUIRE(expected.size() == wb.size());
+				REQUIRE((expected.empty() ||
+				         0 == std::memcmp(expected.data(), wb.data(), expected.size())));
+			}
+		}
+
+		auto path = std::filesystem::temp_directory_path() / "ufocompression_range_test";
+		std::ofstream(path, std::ios::binary) << frame;
+		WriteBuffer wb;
+		REQUIRE(1000 == compressor.decompressRange(path, wb, 50000, 1000));
+		REQUIRE(0 == std::memcmp(data.data() + 50000, wb.data(), 1000));
+		std::filesystem::remove(path);
+	}
+
+	SECTION("Async")
+	{
+		std::vector<std::byte> bytes(data.size());
+		std::memcpy(bytes.data(), data.data(), data.size());
+
+		for (bool native : {false, true}) {
+			std::stringstream in(data);
+			std::stringstream expected;
+			compressor.compress(in, expected, data.size(), native);
+
+			// Several in flight, with the compressor changed while they run
+			std::vector<std::future<std::vector<std::byte>>> futures;
+			for (int i{}; 8 > i; ++i) {
+				futures.push_back(compressor.compressAsync(bytes, native));
+			}
+			compressor.block_size = 1234;
+			for (auto& f : futures) {
+				auto compressed = f.get();
+				REQUIRE(expected.str().size() == compressed.size());
+				REQUIRE(0 == std::memcmp(expected.str().data(), compressed.data(),
+				                         compressed.size()));
+				REQUIRE(bytes == compressor.decompressAsync(compressed, native).get());
+			}
+			compressor.block_size = 4096;
+
+			std::promise<std::vector<std::byte>> promise;
+			compressor.compressAsync(
+			    bytes, [&promise](std::vector<std::byte> result, std::exception_ptr error) {
+				    if (error) {
+					    promise.set_exception(error);
+				    } else {
+					    promise.set_value(std::move(result));
+				    }
+			    },
+			    native);
+			REQUIRE(expected.str().size() == promise.get_future().get().size());
+		}
+
+		REQUIRE_THROWS(compressor.decompressAsync(bytes).get());
+
+		std::promise<std::exception_ptr> error;
+		compressor.decompressAsync(bytes, [&error](auto, std::exception_ptr e) {
+			error.set_value(e);
+		});
+		REQUIRE(error.get_future().get());
+	}
+
+	SECTION("Cancel")
+	{
+		using Reason = ufo::CompressionCancelled::Reason;
+
+		auto reason = [&](bool compress, bool native) -> std::optional<Reason> {
+			std::stringstream in(data);
+			std::stringstream out;
+			if (!compress) {
+				auto copy         = compressor;
+				copy.cancellation = {};
+				copy.deadline     = std::chrono::steady_clock::time_point::max();
+				copy.compress(in, out, data.size(), native);
+				in.str(out.str());
+				out.str("");
+			}
+			try {
+				compress ? compressor.compress(in, out, data.size(), native)
+				         : compressor.decompress(in, out, native);
+			} catch (ufo::CompressionCancelled const& e) {
+				return e.reason();
+			}
+			return std::nullopt;
+		};
+
+		// A default token is never cancelled
+		compressor.cancellation.cancel();
+		REQUIRE_FALSE(compressor.cancellation.cancelled());
+
+		for (std::size_t threads : {1, 4}) {
+			compressor.num_threads = threads;
+			for (bool native : {false, true}) {
+				for (bool compress : {true, false}) {
+					compressor.cancellation = ufo::CancellationToken::create();
+					REQUIRE_FALSE(reason(compress, native));
+
+					// Copies share the state
+					auto copy = compressor;
+					copy.cancellation.cancel();
+					REQUIRE(compressor.cancellation.cancelled());
+					REQUIRE(Reason::CANCELLED == reason(compress, native));
+
+					compressor.cancellation = {};
+					compressor.deadline     = std::chrono::steady_clock::now();
+					REQUIRE(Reason::DEADLINE == reason(compress, native));
+					compressor.deadline = std::chrono::steady_clock::time_point::max();
+				}
+			}
+		}
+
+		// Cancelled while running, after reading the first block
+		compressor.num_threads  = 1;
+		compressor.cancellation = ufo::CancellationToken::create();
+		CancellingBuf buf(data);
+		buf.token = compressor.cancellation;
+		std::istream      in(&buf);
+		std::stringstream out;
+		REQUIRE_THROWS_AS(compressor.compress(in, out, data.size()),
+		                  ufo::CompressionCancelled);
+		REQUIRE(static_cast<std::size_t>(in.tellg()) == compressor.block_size);
+
+		auto bytes = std::vector<std::byte>(data.size());
+		REQUIRE_THROWS_AS(compressor.compressAsync(bytes).get(), ufo::CompressionCancelled);
+	}
+
+	SECTION("File")
+	{
+		namespace fs = std::filesystem;
+
+		auto root = fs::temp_directory_path() / "ufocompression_file_test";
+		fs::create_directories(root);
+		std::ofstream(root / "in", std::ios::binary) << data;
+		std::ofstream(root / "empty", std::ios::binary);
+
+		auto read = [](fs::path const& path) {
+			std::ifstream     in(path, std::ios::binary);
+			std::stringstream ss;
+			ss << in.rdbuf();
+			return ss.str();
+		};
+
+		compressor.num_threads = 4;
+		for (bool native : {false, true}) {
+			// The same as compressing from and to streams
+			std::stringstream in(data);
+			std::stringstream expected;
+			compressor.compress(in, expected, data.size(), native);
+			REQUIRE(expected.str().size() ==
+			        compressor.compressFile(root / "in", root / "compressed", native));
+			REQUIRE(expected.str() == read(root / "compressed"));
+
+			REQUIRE(data.size() ==
+			        compressor.decompressFile(root / "compressed", root / "out", native));
+			REQUIRE(data == read(root / "out"));
+
+			compressor.compressFile(root / "empty", root / "compressed", native);
+			REQUIRE(0 == compressor.decompressFile(root / "compressed", root / "out", native));
+			REQUIRE(0 == fs::file_size(root / "out"));
+		}
+
+		REQUIRE_THROWS(compressor.compressFile(root / "missing", root / "compressed"));
+		fs::remove(root / "out");
+		REQUIRE_THROWS(compressor.decompressFile(root / "in", root / "out"));
+		REQUIRE_FALSE(fs::exists(root / "out"));
+
+		// Failing after the output is created leaves no partial file behind
+		for (bool native : {false, true}) {
+			compressor.compressFile(root / "in", root / "compressed", native);
+			auto compressed = read(root / "compressed");
+			for (std::size_t i = compressed.size() / 4; compressed.size() / 2 > i; ++i) {
+				compressed[i] = static_cast<char>(~compressed[i]);
+			}
+			std::ofstream(root / "corrupt", std::ios::binary) << compressed;
+
+			REQUIRE_THROWS(compressor.decompressFile(root / "corrupt", root / "out", native));
+			REQUIRE_FALSE(fs::exists(root / "out"));
+		}
+
+		fs::remove_all(root);
+	}
+
+	SECTION("Corrupt")
+	{
+		std::stringstream in(data);
+		std::stringstream compressed;
+		compressor.compress(in, compressed, data.size());
+
+		auto str = compressed.str();
+		str.resize(str.size() / 2);
+		std::stringstream truncated(str);
+		std::stringstream out;
+		REQUIRE_THROWS(Compressor::decompress(truncated, out));
+
+		// Failing while decoding leaves both buffers as they were
+		str = compressed.str();
+		for (std::size_t i = str.size() / 4; str.size() / 2 > i; ++i) {
+			str[i] = static_cast<char>(~str[i]);
+		}
+		ReadBuffer  rb(reinterpret_cast<std::byte const*>(str.data()), str.size());
+		WriteBuffer wb;
+		wb.write("head", 4);
+		REQUIRE_THROWS(Compressor::decompress(rb, wb));
+		REQUIRE(4 == wb.size());
+		REQUIRE(4 == wb.writeIndex());
+		REQUIRE(0 == rb.readIndex());
+
+		// A header claiming more data than the frame can hold is rejected before anything
+		// is sized from it
+		auto          header   = compressed.str();
+		std::uint64_t sizes[2] = {data.size(), compressor.block_size};
+		auto pos = header.find(std::string(reinterpret_cast<char*>(sizes), sizeof(sizes)));
+		REQUIRE(std::string::npos != pos);
+		for (std::uint64_t size : {std::uint64_t(1) << 60, ~std::uint64_t(0)}) {
+			std::memcpy(header.data() + pos, &size, sizeof(size));
+			ReadBuffer  hrb(reinterpret_cast<std::byte const*>(header.data()), header.size());
+			WriteBuffer hwb;
+			REQUIRE_THROWS_AS(Compressor::decompress(hrb, hwb), std::runtime_error);
+			REQUIRE(0 == hwb.size());
+			std::stringstream hin(header);
+			std::stringstream hout;
+			REQUIRE_THROWS_AS(Compressor::decompress(hin, hout), std::runtime_error);
+		}
+
+		// Also a block size larger than the format allows
+		header   = compressed.str();
+		sizes[1] = (std::uint64_t(1) << 30) + 1;
+		std::memcpy(header.data() + pos + sizeof(std::uint64_t), &sizes[1], sizeof(sizes[1]));
+		std::stringstream bin(header);
+		std::stringstream bout;
+		REQUIRE_THROWS_AS(Compressor::decompress(bin, bout), std::runtime_error);
+
+		// A corrupt chain length, right after the magic and version
+		auto chain = compressed.str();
+		for (std::uint32_t size : {std::uint32_t(0), ~std::uint32_t(0)}) {
+			std::memcpy(chain.data() + 2 * sizeof(std::uint32_t), &size, sizeof(size));
+			ReadBuffer  crb(reinterpret_cast<std::byte const*>(chain.data()), chain.size());
+			WriteBuffer cwb;
+			REQUIRE_THROWS_AS(Compressor::decompress(crb, cwb), std::runtime_error);
+			std::stringstream cin(chain);
+			std::stringstream cout;
+			REQUIRE_THROWS_AS(Compressor::decompress(cin, cout), std::runtime_error);
+		}
+
+		// A block failing on a worker, with other blocks still in flight
+		compressor.num_threads = 4;
+		for (int i{}; 10 > i; ++i) {
+			std::stringstream cin(str);
+			std::stringstream cout;
+			REQUIRE_THROWS(compressor.decompress(cin, cout, false));
+		}
+	}
+}
+
+TEST_CASE("Archive")
+{
+	namespace fs = std::filesystem;
+
+	auto root = fs::temp_directory_path() / "ufocompression_archive_test";
+	fs::remove_all(root);
+	auto map = root / "map";
+
+	// Tiles of a map session, with an empty file, an empty directory, and a file larger
+	// than a block
+	std::vector<std::pair<std::string, std::string>> files;
+	for (int i{}; 20 > i; ++i) {
+		auto path = "tiles/" + std::to_string(i % 4) + "/" + std::to_string(i) + ".ufo";
+		files.emplace_back(path, testData(1000 * i));
+	}
+	files.emplace_back("empty", "");
+	files.emplace_back("large", testData(300000));
+	fs::create_directories(map / "unused");
+	for (auto const& [path, data] : files) {
+		fs::create_directories((map / path).parent_path());
+		std::ofstream(map / path, std::ios::binary) << data;
+	}
+
+	auto read = [](fs::path const& path) {
+		std::ifstream     in(path, std::ios::binary);
+		std::stringstream ss;
+		ss << in.rdbuf();
+		return ss.str();
+	};
+
+	CompressorLZ4 lz4;
+	lz4.block_size = 64 * 1024;
+	for (std::size_t num_threads : {1, 4}) {
+		lz4.num_threads = num_threads;
+		auto out        = root / ("out" + std::to_string(num_threads));
+		auto written    = lz4.compress(map, root / "map.ufoa");
+		REQUIRE(fs::file_size(root / "map.ufoa") == written);
+
+		std::size_t total{};
+		for (auto const& [path, data] : files) {
+			total += data.size();
+		}
+		REQUIRE(written < total);
+		REQUIRE(total == lz4.decompress(root / "map.ufoa", out));
+		for (auto const& [path, data] : files) {
+			REQUIRE(data == read(out / path));
+		}
+		REQUIRE(fs::is_directory(out / "unused"));
+	}
+
+	// A single file
+	REQUIRE(0 < lz4.compress(map / "large", root / "large.ufoa"));
+	REQUIRE(300000 == lz4.decompress(root / "large.ufoa", root / "single"));
+	REQUIRE(files.back().second == read(root / "single" / "large"));
+
+	// Truncated
+	auto archive = read(root / "map.ufoa");
+	std::ofstream(root / "truncated.ufoa", std::ios::binary)
+	    << archive.substr(0, archive.size() / 2);
+	REQUIRE_THROWS(lz4.decompress(root / "truncated.ufoa", root / "truncated"));
+	REQUIRE_THROWS(lz4.compress(root / "missing", root / "missing.ufoa"));
+
+	// Failing while files are being compressed leaves no partial archive behind
+	lz4.cancellation = CancellationToken::create();
+	lz4.cancellation.cancel();
+	for (std::size_t num_threads : {1, 4}) {
+		lz4.num_threads = num_threads;
+		REQUIRE_THROWS_AS(lz4.compress(map, root / "cancelled.ufoa"), CompressionCancelled);
+		REQUIRE_FALSE(fs::exists(root / "cancelled.ufoa"));
+	}
+
+	fs::remove_all(root);
+}
+
+TEST_CASE("Thread Pool")
+{
+	auto& pool = ufo::ThreadPool::shared();
+	REQUIRE(0 < pool.size());
+	REQUIRE_THROWS(ufo::ThreadPool::configure({}));
+
+	// Tasks waiting on tasks they submitted, more of them than there are threads
+	std::vector<std::future<int>> futures;
+	for (int i{}; 4 * static_cast<int>(pool.size()) > i; ++i) {
+		futures.push_back(pool.submit([&pool, i]() {
+			std::vector<std::future<int>> subtasks;
+			for (int j{}; 8 > j; ++j) {
+				subtasks.push_back(pool.submit([i, j]() { return i * j; }));
+			}
+			int sum{};
+			for (auto& f : subtasks) {
+				pool.wait(f);
+				sum += f.get();
+			}
+			return sum;
+		}));
+	}
+	for (int i{}; static_cast<int>(futures.size()) > i; ++i) {
+		pool.wait(futures[i]);
+		REQUIRE(28 * i == futures[i].get());
+	}
+
+	ufo::ThreadPool pinned(ufo::ThreadPool::Config{2, {0}});
+	REQUIRE(2 == pinned.size());
+	REQUIRE(42 == pinned.submit([]() { return 42; }).get());
+
+	// Queued tasks run most urgent first, and tasks inherit the priority of their parent
+	ufo::ThreadPool                single(1);
+	std::promise<void>             release;
+	std::shared_future<void>       released = release.get_future().share();
+	std::vector<int>               order;
+	std::vector<std::future<void>> queued;
+	auto blocker = single.submit([released]() { released.wait(); });
+	for (auto [p, i] : {std::pair{ufo::Priority::LOW, 0}, {ufo::Priority::NORMAL, 1},
+	                    {ufo::Priority::HIGH, 2}, {ufo::Priority::LOW, 3}}) {
+		queued.push_back(single.submit(p, [&order, i]() { order.push_back(i); }));
+	}
+	auto inherited = single.submit(ufo::Priority::HIGH, [&single]() {
+		auto f = single.submit([&single]() { return single.priority(); });
+		single.wait(f);
+		return f.get();
+	});
+	release.set_value();
+	blocker.get();
+	for (auto& f : queued) {
+		f.get();
+	}
+	REQUIRE(std::vector<int>{2, 1, 0, 3} == order);
+	REQUIRE(ufo::Priority::HIGH == inherited.get());
+	REQUIRE(ufo::Priority::NORMAL == single.priority());
+}
\ No newline at end of file